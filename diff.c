@@ -0,0 +1,283 @@
+#include "diff.h"
+
+/**
+ * prints how mdu diff is used
+ *
+ * @return      void
+ */
+void diff_usage(void)
+{
+    fprintf(stderr, "usage: mdu diff OLD NEW [--top N] [--relative] [-b | --apparent-size | --inodes | --blocks]\n");
+}
+
+/**
+ * gives the score of a diff entry for the heap
+ *
+ * @param entry     pointer to the entry
+ * @return      its score
+ */
+double diff_score(const void* entry)
+{
+    return ((const struct diff_entry*)entry)->score;
+}
+
+/**
+ * scores a directory and keeps it if it's among the top ones
+ *
+ * @param diff_job     the diff to add to
+ * @param kind     how the directory changed
+ * @param index     index of the directory, in the old snapshot if it was removed, else in the new one
+ * @param old_size     size in the old snapshot
+ * @param new_size     size in the new snapshot
+ * @return      void
+ */
+void diff_push(struct diff_job* diff_job, enum diff_kind kind, uint64_t index, uint64_t old_size, uint64_t new_size)
+{
+    struct diff_entry entry;
+    entry.growth = (int64_t)new_size - (int64_t)old_size;
+    entry.old_size = old_size;
+    entry.index = index;
+    entry.kind = kind;
+    if (entry.growth == 0)
+    {
+        return;
+    }
+    if (!diff_job->relative)
+    {
+        entry.score = (double)entry.growth;
+    }
+    else if (kind == DIFF_ADDED || old_size == 0)
+    {
+        entry.score = INFINITY;
+    }
+    else
+    {
+        entry.score = (double)entry.growth / (double)old_size;
+    }
+    top_push(&diff_job->heap, &entry);
+}
+
+/**
+ * merge-joins the children of a directory that is in both snapshots, children are sorted by name in both
+ * subtrees that are only in one of them are rolled up into one entry instead of being walked
+ * the ends of both directories have to have been checked with snap_end already
+ *
+ * @param diff_job     the diff that is running
+ * @param old_index     index of the directory in the old snapshot
+ * @param new_index     index of the directory in the new snapshot
+ * @return      void
+ */
+void diff_merge(struct diff_job* diff_job, uint64_t old_index, uint64_t new_index)
+{
+    const struct snap_map* old_map = &diff_job->old_map;
+    const struct snap_map* new_map = &diff_job->new_map;
+    uint64_t old_end = old_map->nodes[old_index].end;
+    uint64_t new_end = new_map->nodes[new_index].end;
+    uint64_t old_child = old_index + 1;
+    uint64_t new_child = new_index + 1;
+
+    while (old_child < old_end || new_child < new_end)
+    {
+        int cmp;
+        if (old_child >= old_end)
+        {
+            cmp = 1;
+        }
+        else if (new_child >= new_end)
+        {
+            cmp = -1;
+        }
+        else
+        {
+            cmp = strcmp(snap_name(old_map, old_child), snap_name(new_map, new_child));
+        }
+
+        if (cmp == 0)
+        {
+            uint64_t old_next = snap_end(old_map, old_child, old_end); // before going down
+            uint64_t new_next = snap_end(new_map, new_child, new_end);
+            diff_merge(diff_job, old_child, new_child);
+            old_child = old_next;
+            new_child = new_next;
+        }
+        else if (cmp < 0)
+        {
+            diff_push(diff_job, DIFF_REMOVED, old_child, snap_size(old_map, old_child), 0);
+            old_child = snap_end(old_map, old_child, old_end);
+        }
+        else
+        {
+            diff_push(diff_job, DIFF_ADDED, new_child, 0, snap_size(new_map, new_child));
+            new_child = snap_end(new_map, new_child, new_end);
+        }
+    }
+    diff_push(diff_job, DIFF_CHANGED, new_index, snap_size(old_map, old_index), snap_size(new_map, new_index));
+}
+
+/**
+ * compares two diff entries for qsort, highest score first
+ *
+ * @param a     pointer to the first entry
+ * @param b     pointer to the second entry
+ * @return      <0, 0 or >0
+ */
+int diff_compare(const void* a, const void* b)
+{
+    const struct diff_entry* first = a;
+    const struct diff_entry* second = b;
+    if (first->score != second->score)
+    {
+        return first->score < second->score ? 1 : -1;
+    }
+    if (first->growth != second->growth)
+    {
+        return first->growth < second->growth ? 1 : -1;
+    }
+    return first->index < second->index ? -1 : (first->index > second->index);
+}
+
+/**
+ * prints the kept directories, most growth first
+ *
+ * @param diff_job     the diff to print
+ * @return      void
+ */
+void diff_print(struct diff_job* diff_job)
+{
+    top_sort(&diff_job->heap, diff_compare);
+    for (size_t i = 0; i < diff_job->heap.num; i++)
+    {
+        const struct diff_entry* entry = top_entry(&diff_job->heap, i);
+        char* path;
+        if (entry->kind == DIFF_REMOVED)
+        {
+            path = snap_path(&diff_job->old_map, entry->index);
+            printf("%+" PRId64 "\tremoved\t%s\n", entry->growth, path);
+        }
+        else if (entry->kind == DIFF_ADDED)
+        {
+            path = snap_path(&diff_job->new_map, entry->index);
+            printf("%+" PRId64 "\tadded\t%s\n", entry->growth, path);
+        }
+        else
+        {
+            path = snap_path(&diff_job->new_map, entry->index);
+            if (entry->old_size == 0)
+            {
+                printf("%+" PRId64 "\t\t%s\n", entry->growth, path);
+            }
+            else
+            {
+                printf("%+" PRId64 "\t%+.1f%%\t%s\n", entry->growth, 100.0 * (double)entry->growth / (double)entry->old_size, path);
+            }
+        }
+        free(path);
+    }
+}
+
+/**
+ * runs mdu diff, lists the directories that grew the most between two snapshots written with --snapshot
+ * roots are matched by the path they were given as
+ *
+ * @param argc     the argc after the "diff" word
+ * @param argv     the argv starting at the "diff" word
+ * @return      the exit code
+ */
+int diff_main(int argc, char** argv)
+{
+    static struct option long_options[] = {
+        {"top", required_argument, NULL, 't'},
+        {"relative", no_argument, NULL, 'r'},
+        {"apparent-size", no_argument, NULL, 'b'},
+        {"inodes", no_argument, NULL, 'I'},
+        {"blocks", no_argument, NULL, 'B'},
+        {NULL, 0, NULL, 0}
+    };
+    int metric = METRIC_BLOCKS;
+    struct diff_job diff_job;
+    diff_job.relative = false;
+    long top = DIFF_TOP;
+    int argnum;
+    while ((argnum = getopt_long(argc, argv, "t:rb", long_options, NULL)) != -1)
+    {
+        if (snap_metric_opt(argnum) != 0)
+        {
+            metric = snap_metric_opt(argnum);
+        }
+        else if (argnum == 't')
+        {
+            top = atol(optarg);
+            if (top < 1)
+            {
+                fprintf(stderr, "--top needs at least 1\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (argnum == 'r')
+        {
+            diff_job.relative = true;
+        }
+        else
+        {
+            diff_usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 2)
+    {
+        diff_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    snap_map_open(&diff_job.old_map, argv[optind]);
+    snap_map_open(&diff_job.new_map, argv[optind + 1]);
+    diff_job.old_map.metric = metric;
+    diff_job.new_map.metric = metric;
+    top_init(&diff_job.heap, (size_t)top, sizeof(struct diff_entry), diff_score);
+
+    const struct snap_map* old_map = &diff_job.old_map;
+    const struct snap_map* new_map = &diff_job.new_map;
+    uint64_t old_num = old_map->header->num_nodes;
+    uint64_t new_num = new_map->header->num_nodes;
+    uint64_t new_next;
+    for (uint64_t new_root = 0; new_root < new_num; new_root = new_next)
+    {
+        new_next = snap_end(new_map, new_root, new_num);
+        uint64_t old_root = 0;
+        while (old_root < old_num)
+        {
+            uint64_t old_next = snap_end(old_map, old_root, old_num);
+            if (strcmp(snap_name(old_map, old_root), snap_name(new_map, new_root)) == 0)
+            {
+                break;
+            }
+            old_root = old_next;
+        }
+        if (old_root < old_num)
+        {
+            diff_merge(&diff_job, old_root, new_root);
+        }
+        else
+        {
+            diff_push(&diff_job, DIFF_ADDED, new_root, 0, snap_size(new_map, new_root));
+        }
+    }
+    for (uint64_t old_root = 0; old_root < old_num; old_root = snap_end(old_map, old_root, old_num))
+    {
+        uint64_t new_root = 0;
+        while (new_root < new_num && strcmp(snap_name(old_map, old_root), snap_name(new_map, new_root)) != 0)
+        {
+            new_root = snap_end(new_map, new_root, new_num);
+        }
+        if (new_root >= new_num)
+        {
+            diff_push(&diff_job, DIFF_REMOVED, old_root, snap_size(old_map, old_root), 0);
+        }
+    }
+
+    diff_print(&diff_job);
+    top_free(&diff_job.heap);
+    snap_map_close(&diff_job.old_map);
+    snap_map_close(&diff_job.new_map);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+#include <getopt.h>
+#include "snapshot.h"
+#include "top.h"
+
+#define DIFF_TOP 20
+
+// how a directory changed between the two snapshots
+enum diff_kind{
+    DIFF_CHANGED,
+    DIFF_ADDED,
+    DIFF_REMOVED
+};
+
+// a directory in the result heap, index is into the new snapshot unless it was removed
+struct diff_entry{
+    double score;
+    int64_t growth;
+    uint64_t old_size;
+    uint64_t index;
+    enum diff_kind kind;
+};
+
+// structure that holds what the merge needs, shared by the whole diff
+struct diff_job{
+    struct snap_map old_map;
+    struct snap_map new_map;
+    bool relative;
+    struct top heap;
+};
+
+void diff_usage(void);
+double diff_score(const void* entry);
+void diff_push(struct diff_job* diff_job, enum diff_kind kind, uint64_t index, uint64_t old_size, uint64_t new_size);
+void diff_merge(struct diff_job* diff_job, uint64_t old_index, uint64_t new_index);
+int diff_compare(const void* a, const void* b);
+void diff_print(struct diff_job* diff_job);
+int diff_main(int argc, char** argv);
\ No newline at end of file
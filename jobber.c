@@ -61,22 +61,34 @@ struct dirent* safe_readdir(DIR* d, pthread_mutex_t* exitLock, int* exit_code)
 }
 
 /**
- * gets the size of a file
+ * gets the size of a file, and the rest of the metrics from the same lstat
  *
  * @param path     the origin path
  * @param d_name     the file/directory name
- * @return      the 512 block size of the file
+ * @param metrics     the metrics to add the file to
+ * @return      void
  */
-int job_getsize(char* path, const char* d_name)
+void job_getsize(char* path, const char* d_name, struct metrics* metrics)
 {
     char* tempPath = haz_strdup(path);
     tempPath = target_appendstr(tempPath, d_name);
 
     struct stat file;
-    haz_lstat(tempPath, &file);
-    int size = file.st_blocks;
+    uint64_t trace_start = trace_begin();
+    int result = lstat(tempPath, &file);
+    trace_end(TRACE_STAT, trace_start);
+    if (result != 0)
+    {
+        if (errno != ENOENT)
+        {
+            perror("lstat failed");
+            exit(EXIT_FAILURE);
+        }
+        free(tempPath); // removed after it was read from the directory
+        return;
+    }
+    metrics_stat(metrics, &file);
     free(tempPath);
-    return size;
 }
 
 /**
@@ -98,19 +110,17 @@ bool job_kill(struct thread_job* thread_job)
 }
 
 /**
- * adds size to the target that the thread has been working on
+ * adds what the thread measured to its own slot, no lock is needed since only this thread writes it
+ * the slots are read by job_status once every other thread is asleep
  * 
  * @param thread_job     thread_job that is relevant for the thread
- * @param size     size to add
+ * @param id     index of the thread
+ * @param metrics     metrics to add
  * @return      void
  */
-void job_add_size(struct thread_job* thread_job, int size)
+void job_add_size(struct thread_job* thread_job, int id, const struct metrics* metrics)
 {
-    pthread_mutex_lock(&thread_job->targetsLock);
-
-    thread_job->targets[thread_job->current_target].target_size += size;
-
-    pthread_mutex_unlock(&thread_job->targetsLock);
+    metrics_add(&thread_job->slots[id].metrics, metrics);
 }
 
 
@@ -122,17 +132,20 @@ void job_add_size(struct thread_job* thread_job, int size)
  */
 char* job_get(struct thread_job* thread_job)
 {
+    uint64_t trace_start = trace_begin();
     pthread_mutex_lock(&thread_job->targetsLock);
 
     if (thread_job->targets[thread_job->current_target].path_num < 1)
     {
         pthread_mutex_unlock(&thread_job->targetsLock);
+        trace_end(TRACE_GET, trace_start);
         return NULL;
     }
 
     char* tempPath = target_getpath(&thread_job->targets[thread_job->current_target]);
 
     pthread_mutex_unlock(&thread_job->targetsLock);
+    trace_end(TRACE_GET, trace_start);
     return tempPath;
 }
 
@@ -151,7 +164,9 @@ void job_wait(struct thread_job* thread_job)
         thread_job->active_threads--;
         pthread_mutex_unlock(&thread_job->threadsLock);
 
+        uint64_t trace_start = trace_begin();
         sem_wait(&thread_job->sem_threads);
+        trace_end(TRACE_WAIT, trace_start);
         
         pthread_mutex_lock(&thread_job->threadsLock);
         thread_job->active_threads++;
@@ -162,6 +177,32 @@ void job_wait(struct thread_job* thread_job)
 
 
 
+/**
+ * claims the directory of the current target, if it was already read under an earlier target its total is taken from there,
+ * unless that total is partial, then it's read again
+ * has to be called before any thread reads the target
+ *
+ * @param thread_job     thread_job that is relevant for the thread
+ * @return      true if the target has to be read, false if it's already done
+ */
+bool job_start_target(struct thread_job* thread_job)
+{
+    struct target* target = &thread_job->targets[thread_job->current_target];
+    struct stat file;
+    if (thread_job->visit == NULL || stat(target->target, &file) != 0 || !S_ISDIR(file.st_mode)) // opendir says what's wrong with it
+    {
+        return true;
+    }
+    struct visit_dir* found;
+    if (visit_claim(thread_job->visit, &file, NULL, thread_job->current_target, &found)
+        || visit_reuse(thread_job->visit, found, NULL, thread_job->current_target, &target->target_metrics))
+    {
+        return true;
+    }
+    free(target_getpath(target));
+    return false;
+}
+
 /**
  * Checks if the threads should end themselves, or if it should change to another target
  * 
@@ -170,6 +211,7 @@ void job_wait(struct thread_job* thread_job)
  */
 void job_status(struct thread_job* thread_job)
 {
+    uint64_t trace_start = trace_begin();
     pthread_mutex_lock(&thread_job->threadsLock);
     pthread_mutex_lock(&thread_job->targetsLock);
 
@@ -180,15 +222,32 @@ void job_status(struct thread_job* thread_job)
         // so this thread for sure knows that there's nobody else who's gonna give out any more paths
         if (thread_job->active_threads == 1 && thread_job->targets[thread_job->current_target].path_num == 0) 
         {
-            printf("%d\t%s\n", thread_job->targets[thread_job->current_target].target_size, thread_job->targets[thread_job->current_target].target);
-            if ((thread_job->current_target + 1) < thread_job->num_targets)
+            struct target* target = &thread_job->targets[thread_job->current_target];
+            for (int i = 0; i < thread_job->num_threads; i++) // everyone else is asleep, so the slots can be summed
             {
-                thread_job->current_target++;
+                metrics_add(&target->target_metrics, &thread_job->slots[i].metrics);
+                metrics_zero(&thread_job->slots[i].metrics);
             }
-            else if ((thread_job->current_target + 1) == thread_job->num_targets)
+            do // targets that were already read under another one are done as soon as they start
             {
-                thread_job->kill_threads = true;
-            }
+                target = &thread_job->targets[thread_job->current_target];
+                if (!thread_job->quiet)
+                {
+                    metrics_print(&target->target_metrics, thread_job->show, target->target);
+                }
+                if ((thread_job->current_target + 1) < thread_job->num_targets)
+                {
+                    if (thread_job->visit != NULL)
+                    {
+                        visit_finish(thread_job->visit);
+                    }
+                    thread_job->current_target++;
+                }
+                else if ((thread_job->current_target + 1) == thread_job->num_targets)
+                {
+                    thread_job->kill_threads = true;
+                }
+            } while (!thread_job->kill_threads && !job_start_target(thread_job));
             for (int i = 0; i < (thread_job->num_threads -1); i++)
             {
                 sem_post(&thread_job->sem_threads);
@@ -198,6 +257,7 @@ void job_status(struct thread_job* thread_job)
 
     pthread_mutex_unlock(&thread_job->targetsLock);
     pthread_mutex_unlock(&thread_job->threadsLock);
+    trace_end(TRACE_STATUS, trace_start);
 }
 
 
@@ -211,6 +271,7 @@ void job_status(struct thread_job* thread_job)
  */
 void job_checkothers(struct thread_job* thread_job, struct target* target)
 {
+    uint64_t trace_start = trace_begin();
     pthread_mutex_lock(&thread_job->threadsLock);
     pthread_mutex_lock(&thread_job->targetsLock);
     int sem_val = haz_semval(&thread_job->sem_threads);
@@ -239,6 +300,7 @@ void job_checkothers(struct thread_job* thread_job, struct target* target)
     }
     pthread_mutex_unlock(&thread_job->targetsLock);
     pthread_mutex_unlock(&thread_job->threadsLock);
+    trace_end(TRACE_CHECKOTHERS, trace_start);
 }
 
 /**
@@ -246,44 +308,83 @@ void job_checkothers(struct thread_job* thread_job, struct target* target)
  * 
  * @param thread_job     thread_job that is relevant for the thread
  * @param path     the path that should be checked
- * @return      the size the job has measured
+ * @param metrics     where to add what the job has measured
+ * @return      0, or -1 if it got no path
  */
-int job_do(struct thread_job* thread_job, char* path)
+int job_do(struct thread_job* thread_job, char* path, struct metrics* metrics)
 {
     if (path == NULL)
     {
         return -1;
     }
     
+    bool root = strcmp(path, thread_job->targets[thread_job->current_target].target) == 0; // the watch follows it if it's a link
     struct target* target = haz_malloc(sizeof(struct target));
     target_setup(target, path);
+    target->max_mem = thread_job->target_mem;
     char* current_path;
-    int size = 0;
 
     while (target->path_num > 0)
     {
         job_checkothers(thread_job, target);
         current_path = target_getpath(target);
+        struct watch_dir* watch_dir = NULL;
+        if (thread_job->watch != NULL) // watch before reading so changes during the read aren't lost
+        {
+            watch_dir = watch_begin(thread_job->watch, current_path, root);
+            root = false;
+        }
+        struct metrics dir_metrics;
+        metrics_zero(&dir_metrics);
+        uint64_t trace_start = trace_begin();
         DIR* d;
+        struct visit_dir* visit_dir = NULL;
         if ((d = opendir(current_path)) == NULL) // if it's null we can't read directory, but handle the issue
         {
-            size += job_opendir_failed(thread_job, current_path);
+            struct stat self;
+            job_opendir_failed(thread_job, current_path, &self, &dir_metrics);
+            if (thread_job->visit != NULL && thread_job->visit->totals && S_ISDIR(self.st_mode)) // its own size still goes in its total
+            {
+                visit_dir = visit_find(thread_job->visit, &self);
+            }
         }
         else // else read the directory
         {
-            size += job_readdir(thread_job, target, d, current_path);
+            struct stat self; // the directory itself, from the fd so it's the one that was opened
+            if (fstat(dirfd(d), &self) != 0)
+            {
+                perror("fstat failed");
+                exit(EXIT_FAILURE);
+            }
+            metrics_stat(&dir_metrics, &self);
+            if (thread_job->visit != NULL && thread_job->visit->totals)
+            {
+                visit_dir = visit_find(thread_job->visit, &self);
+            }
+            job_readdir(thread_job, target, d, current_path, visit_dir, &dir_metrics);
             if (closedir(d) != 0)
             {
                 perror("closedir failed");
                 exit(EXIT_FAILURE);
             }
         }
+        trace_end(TRACE_READDIR, trace_start);
+        if (watch_dir != NULL)
+        {
+            watch_record(thread_job->watch, watch_dir, &dir_metrics);
+        }
+        if (visit_dir != NULL) // only this thread reads it, the total is rolled up once the target is done
+        {
+            visit_store(thread_job->visit, visit_dir->total, &dir_metrics);
+        }
+        metrics_add(metrics, &dir_metrics);
         free(current_path);
     }
+    target_closespill(target);
     free(target->path_list);
     free(target->target);
     free(target);
-    return size;
+    return 0;
 }
 
 /**
@@ -292,38 +393,40 @@ int job_do(struct thread_job* thread_job, char* path)
  * @param target     target to write to
  * @param d     DIR* d pointer to read from
  * @param current_path     path to where the directory is
- * @return      the size of the files and the directory itself
+ * @param parent     the directory in the visited set, NULL if it's not in one
+ * @param metrics     where to add the files and the directory itself
+ * @return      void
  */
-int job_readdir(struct thread_job* thread_job, struct target* target, DIR* d, char* current_path)
+void job_readdir(struct thread_job* thread_job, struct target* target, DIR* d, char* current_path, struct visit_dir* parent, struct metrics* metrics)
 {
-    int size = 0;
     struct dirent* dir;
     while ((dir = safe_readdir(d, &thread_job->exitLock, thread_job->exit_code)) != NULL)
     {
-        if (dir->d_type != DT_UNKNOWN)
+        if (thread_job->follow && (dir->d_type == DT_LNK || dir->d_type == DT_UNKNOWN)) // has to be stated to know if it's a directory
+        {
+            job_subdir(thread_job, target, d, current_path, dir->d_name, parent, metrics);
+        }
+        else if (dir->d_type != DT_UNKNOWN)
         {
             if (dir->d_type == DT_DIR)
             {
-                if (strcmp(dir->d_name,".") != 0 && strcmp(dir->d_name,"..") != 0) // add paths that are not . ..
-                {
-                    target_addcatpath(target, current_path, dir->d_name);
-                }
-                if (strcmp(dir->d_name,".") == 0) // add size for self directory
+                if (strcmp(dir->d_name,".") != 0 && strcmp(dir->d_name,"..") != 0) // add paths that are not . .., the directory itself was counted from its fd
                 {
-                    size += job_getsize(current_path, dir->d_name); 
+                    job_subdir(thread_job, target, d, current_path, dir->d_name, parent, metrics);
                 }
             }
             else
             {
-                size += job_getsize(current_path, dir->d_name); // add size of file
+                job_getsize(current_path, dir->d_name, metrics); // add size of file
             }
         }
         else {
-            fprintf(stderr,"size of unkown is %d\n", (int)job_getsize(current_path, dir->d_name)); // in case there's an unknown size I don't know what else cold happen
+            struct metrics unknown;
+            metrics_zero(&unknown);
+            job_getsize(current_path, dir->d_name, &unknown);
+            fprintf(stderr,"size of unkown is %" PRId64 "\n", unknown.blocks); // in case there's an unknown size I don't know what else cold happen
         }
     }
-    
-    return size;
 }
 
 /**
@@ -331,11 +434,17 @@ int job_readdir(struct thread_job* thread_job, struct target* target, DIR* d, ch
  * 
  * @param thread_job     thread_job that is relevant for the thread
  * @param current_path     the path that should be checked
- * @return      the size of the file, or 0 if it couldn't opendir for other reason
+ * @param file     set to what was counted, a st_mode of 0 if nothing was
+ * @param metrics     where to add the file, or the directory that couldn't be read
+ * @return      void
  */
-int job_opendir_failed(struct thread_job* thread_job, char* current_path)
+void job_opendir_failed(struct thread_job* thread_job, char* current_path, struct stat* file, struct metrics* metrics)
 {
-    int size = 0;
+    file->st_mode = 0;
+    if (errno == ENOENT && thread_job->watch != NULL) // removed while watching, the event for it is on its way
+    {
+        return;
+    }
     if (errno == EACCES) // google says this is thread safe...
     {
         pthread_mutex_lock(&thread_job->exitLock);
@@ -357,9 +466,70 @@ int job_opendir_failed(struct thread_job* thread_job, char* current_path)
         pthread_mutex_unlock(&thread_job->exitLock);
     }
     { // still has to measure the size of the folder... but if this folder doesn't exist or something maybe program will crash
-        struct stat file;
-        haz_lstat(current_path, &file); // will crash on the other errno problem I think, but I don't know how I'm suposed to deal with it, since it's probably an invalid path.
-        size += file.st_blocks;
+        if (stat(current_path, file) != 0 || !S_ISDIR(file->st_mode)) // a link to a directory counts as the directory, like it does when it can be read
+        {
+            haz_lstat(current_path, file); // will crash on the other errno problem I think, but I don't know how I'm suposed to deal with it, since it's probably an invalid path.
+        }
+        metrics_stat(metrics, file);
     }
-    return size;
-}
\ No newline at end of file
+}
+
+/**
+ * adds a subdirectory to the target unless it was already read, stats it first to know if it's a directory when following symlinks
+ * a directory that was read under an earlier target adds its total from there instead
+ *
+ * @param thread_job     thread_job that is relevant for the thread
+ * @param target     target to add to
+ * @param d     the directory it's in
+ * @param current_path     path to the directory it's in
+ * @param d_name     name of the subdirectory
+ * @param parent     the directory it's in in the visited set, or NULL
+ * @param metrics     where to add it if it's not a directory after all, or to add the earlier total
+ * @return      void
+ */
+void job_subdir(struct thread_job* thread_job, struct target* target, DIR* d, char* current_path, const char* d_name, struct visit_dir* parent, struct metrics* metrics)
+{
+    if (strcmp(d_name, ".") == 0 || strcmp(d_name, "..") == 0)
+    {
+        return;
+    }
+    if (thread_job->visit == NULL && !thread_job->follow)
+    {
+        target_addcatpath(target, current_path, d_name);
+        return;
+    }
+
+    struct stat file;
+    uint64_t trace_start = trace_begin();
+    int result = fstatat(dirfd(d), d_name, &file, thread_job->follow ? 0 : AT_SYMLINK_NOFOLLOW);
+    if (result != 0 && thread_job->follow && (errno == ENOENT || errno == ELOOP)) // a broken link counts as itself
+    {
+        result = fstatat(dirfd(d), d_name, &file, AT_SYMLINK_NOFOLLOW);
+    }
+    trace_end(TRACE_STAT, trace_start);
+    if (result != 0)
+    {
+        if (errno != ENOENT) // else removed after it was read from the directory
+        {
+            pthread_mutex_lock(&thread_job->exitLock);
+            fprintf(stderr,"stat failed at %s/%s: ", current_path, d_name);
+            perror("");
+            *thread_job->exit_code = 1;
+            pthread_mutex_unlock(&thread_job->exitLock);
+        }
+        return;
+    }
+    if (!S_ISDIR(file.st_mode))
+    {
+        metrics_stat(metrics, &file);
+        return;
+    }
+
+    struct visit_dir* found;
+    if (thread_job->visit != NULL && !visit_claim(thread_job->visit, &file, parent, thread_job->current_target, &found)
+        && !visit_reuse(thread_job->visit, found, parent, thread_job->current_target, metrics)) // counted already, or an earlier target's total is taken
+    {
+        return;
+    }
+    target_addcatpath(target, current_path, d_name);
+}
@@ -10,6 +10,21 @@
 #include <semaphore.h>
 #include <pthread.h>
 #include "target.h"
+#include "watch.h"
+#include "trace.h"
+#include "visit.h"
+
+// each thread adds what it measured to its own slot, so the threads don't share a lock or a cache line for it
+// the slots are summed into the target when it's done
+struct thread_slot{
+    _Alignas(64) struct metrics metrics;
+};
+
+// what a thread gets when it's created
+struct thread_arg{
+    struct thread_job* thread_job;
+    int id;
+};
 
 // struct for the thread_job that all the threads share
 struct thread_job{
@@ -26,18 +41,30 @@ struct thread_job{
 
     int* exit_code;
     pthread_mutex_t exitLock;
+
+    struct thread_slot* slots;
+    int show; // METRIC_ flags to print
+
+    struct watch* watch; // NULL unless --watch, directories are recorded into it as they are read
+    bool quiet; // don't print the totals, used for the scans the watch does
+    struct trace* trace; // NULL unless --trace
+    size_t target_mem; // bytes of paths each target keeps in memory before spilling, 0 for no limit
+    bool follow; // follow symlinks below the targets too
+    struct visit_set* visit; // directories that were read, NULL to not check, which the watch doesn't
 };
 int haz_semval(sem_t* sem);
 void haz_lstat(char* path, struct stat* stat);
-int job_getsize(char* path, const char* d_name);
-int job_readdir(struct thread_job* thread_job, struct target* target, DIR* d, char* current_path);
+void job_getsize(char* path, const char* d_name, struct metrics* metrics);
+void job_readdir(struct thread_job* thread_job, struct target* target, DIR* d, char* current_path, struct visit_dir* parent, struct metrics* metrics);
+void job_subdir(struct thread_job* thread_job, struct target* target, DIR* d, char* current_path, const char* d_name, struct visit_dir* parent, struct metrics* metrics);
 struct dirent* safe_readdir(DIR* d, pthread_mutex_t* exitLock, int* exit_code);
-int job_opendir_failed(struct thread_job* thread_job, char* current_path);
+void job_opendir_failed(struct thread_job* thread_job, char* current_path, struct stat* file, struct metrics* metrics);
 bool job_kill(struct thread_job* thread_job);
 void job_wait(struct thread_job* thread_job);
 char* job_get(struct thread_job* thread_job);
-int job_do(struct thread_job* thread_job, char* path);
-void job_add_size(struct thread_job* thread_job, int size);
+int job_do(struct thread_job* thread_job, char* path, struct metrics* metrics);
+void job_add_size(struct thread_job* thread_job, int id, const struct metrics* metrics);
+bool job_start_target(struct thread_job* thread_job);
 void job_status(struct thread_job* thread_job);
 void job_checkothers(struct thread_job* thread_job, struct target* target);
 
@@ -16,38 +16,146 @@ void haz_mutex_init(pthread_mutex_t* mutex)
 }
 
 /**
- * checks through the argv for options, sets pointers to wanted values;
+ * parses a size like 512M, suffixes are powers of 1024, exits if it isn't one
+ *
+ * @param arg     the size as given
+ * @return      the size in bytes
+ */
+size_t parse_size(const char* arg)
+{
+    char* end;
+    errno = 0;
+    unsigned long long size = strtoull(arg, &end, 10);
+    int shift = 0;
+    if (*end != '\0' && end[1] == '\0')
+    {
+        const char* suffixes = "KMGT";
+        const char* suffix = strchr(suffixes, *end & ~0x20); // either case
+        shift = suffix != NULL ? 10 * (int)(suffix - suffixes + 1) : -1;
+        end++;
+    }
+    if (errno != 0 || end == arg || *end != '\0' || shift < 0 || arg[0] == '-' || size > (SIZE_MAX >> shift))
+    {
+        fprintf(stderr,"program shut down, %s is not a size\n", arg);
+        exit(EXIT_FAILURE);
+    }
+    return (size_t)size << shift;
+}
+
+/**
+ * checks through the argv for options, sets the wanted values in opts;
  * 
  * @param argc     the argc the program got at start
  * @param argv     pointer of argv the program got at start
- * @param get_threadnum     pointer to communicate number of threads, which is set to number of threads to use;
- * @param get_optind     a pointer to a copy of optind, though optind is a global variable, seems more proper to global variable here since it wasn't set during this function
+ * @param opts     pointer to the options to fill in, optind is copied into it since it wasn't set during this function
  * @return      void
  */
-void get_opts(int argc, char** argv, int* get_threadnum, int* get_optind)
+void get_opts(int argc, char** argv, struct mdu_opts* opts)
 {
+    static struct option long_options[] = {
+        {"snapshot", required_argument, NULL, 's'},
+        {"watch", no_argument, NULL, 'w'},
+        {"interval", required_argument, NULL, 'i'},
+        {"apparent-size", no_argument, NULL, 'b'},
+        {"inodes", no_argument, NULL, 'I'},
+        {"blocks", no_argument, NULL, 'B'},
+        {"types", no_argument, NULL, 'T'},
+        {"trace", required_argument, NULL, 'r'},
+        {"max-mem", required_argument, NULL, 'm'},
+        {NULL, 0, NULL, 0}
+    };
     //get the arguments/options and set number of threads
     int argnum;
-    *get_threadnum = 1;
-    while ((argnum = getopt(argc, argv, "j:")) != -1) // this was considered ok in mmake
+    opts->threadnum = 1;
+    opts->snapshot = NULL;
+    opts->watch = false;
+    opts->interval = WATCH_INTERVAL;
+    opts->show = 0;
+    opts->trace = NULL;
+    opts->max_mem = 0;
+    opts->follow = false;
+    while ((argnum = getopt_long(argc, argv, "j:bLH", long_options, NULL)) != -1) // this was considered ok in mmake
     {
 
         if (argnum == 'j'){
-            *get_threadnum = atoi(optarg);
-            if (*get_threadnum < 1)
+            opts->threadnum = atoi(optarg);
+            if (opts->threadnum < 1)
             {
                 fprintf(stderr,"Less than one thread assigned, or no integers, setting threads to 1\n");
-                *get_threadnum = 1;
+                opts->threadnum = 1;
             }
             
         }
+        else if (argnum == 's')
+        {
+            opts->snapshot = optarg;
+        }
+        else if (argnum == 'w')
+        {
+            opts->watch = true;
+        }
+        else if (argnum == 'b')
+        {
+            opts->show |= METRIC_BYTES;
+        }
+        else if (argnum == 'I')
+        {
+            opts->show |= METRIC_INODES;
+        }
+        else if (argnum == 'B')
+        {
+            opts->show |= METRIC_BLOCKS;
+        }
+        else if (argnum == 'T')
+        {
+            opts->show |= METRIC_TYPES;
+        }
+        else if (argnum == 'r')
+        {
+            opts->trace = optarg;
+        }
+        else if (argnum == 'L')
+        {
+            opts->follow = true;
+        }
+        else if (argnum == 'H') // only follow the targets, which is what happens anyway
+        {
+            opts->follow = false;
+        }
+        else if (argnum == 'm')
+        {
+            opts->max_mem = parse_size(optarg);
+        }
+        else if (argnum == 'i')
+        {
+            opts->interval = atoi(optarg);
+            if (opts->interval < 1)
+            {
+                fprintf(stderr,"interval has to be at least one second, setting it to 1\n");
+                opts->interval = 1;
+            }
+        }
         else
         {
             fprintf(stderr,"program shut down, %c is not an option or invalid argument\n", (char)optopt); // I dunno, looks nice I guess, did not use this i mmake but was ok anyway
             exit(EXIT_FAILURE);
         }
     }
-    *get_optind = optind;
+    if (opts->watch && opts->snapshot != NULL)
+    {
+        fprintf(stderr,"program shut down, --watch and --snapshot can't be used together\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts->follow && (opts->watch || opts->snapshot != NULL))
+    {
+        fprintf(stderr,"program shut down, -L can't be used with --watch or --snapshot\n");
+        exit(EXIT_FAILURE);
+    }
+    if (opts->show == 0)
+    {
+        opts->show = METRIC_BLOCKS;
+    }
+    opts->optind = optind;
 }
 
 /**
@@ -69,6 +177,23 @@ struct thread_job* create_thread_job(int argc, char** argv, int threadnum, int s
     thread_job->kill_threads = false;
     thread_job->exit_code = exit_code;
     thread_job->active_threads = threadnum;
+    thread_job->watch = NULL;
+    thread_job->quiet = false;
+    thread_job->trace = NULL;
+    thread_job->target_mem = 0;
+    thread_job->follow = false;
+    thread_job->visit = NULL;
+    thread_job->show = METRIC_BLOCKS;
+    // aligned so that every slot has a cache line of its own
+    if ((thread_job->slots = aligned_alloc(_Alignof(struct thread_slot), sizeof(struct thread_slot) * threadnum)) == NULL)
+    {
+        fprintf(stderr, "failed to allocate space");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < threadnum; i++)
+    {
+        metrics_zero(&thread_job->slots[i].metrics);
+    }
     if (sem_init(&thread_job->sem_threads, 0, 0) != 0)
     {
         perror("failed to init semaphore");
@@ -106,13 +231,15 @@ struct thread_job* create_thread_job(int argc, char** argv, int threadnum, int s
  * it'll check if it should change the jobs, if not it'll try and get a job, if it got no job then thread goes to sleep
  * if it did get a job it'll do the job and in that job it may wakeup threads, it'll only return once it's reached the end of the directory
  * 
- * @param arg     a void pointer to a thrad_job
+ * @param arg     a void pointer to a thread_arg
  * @return      void*
  */
 void* thread_loop(void* arg)
 {
     struct thread_job* thread_job;
-    thread_job = (struct thread_job*) arg;
+    thread_job = ((struct thread_arg*) arg)->thread_job;
+    int id = ((struct thread_arg*) arg)->id;
+    trace_attach(thread_job->trace, id);
     // idea, do the work loop, and add to a local list, add paths as many times as there are inactive threads
     while (!job_kill(thread_job))
     {
@@ -123,14 +250,15 @@ void* thread_loop(void* arg)
         }
         else
         {
-            int size = job_do(thread_job, path);
-            if (size < 0)
+            struct metrics metrics;
+            metrics_zero(&metrics);
+            if (job_do(thread_job, path, &metrics) < 0)
             {
                 fprintf(stderr, "job_do got a NULL job, shouldn't have happened but proceed\n");
             }
             else
             {
-                job_add_size(thread_job, size);
+                job_add_size(thread_job, id, &metrics);
                 free(path);
             }
         }
@@ -140,28 +268,20 @@ void* thread_loop(void* arg)
 }
 
 /**
- * main of mdu, runs the program. Cleans up everything before it quits.
+ * starts the threads on a thread_job and waits for them to finish all of its targets
  * 
- * @param argc     the argc the program got at start
- * @param argv     pointer of argv the program got at start
- * @return      a pointer to the thread_job that it created
+ * @param thread_job     the thread_job to run
+ * @return      void
  */
-int main(int argc, char **argv)
+void run_threads(struct thread_job* thread_job)
 {
-    int* exit_code = haz_malloc(sizeof(int));
-    int* get_threadnum = haz_malloc(sizeof(int));
-    int* get_optind = haz_malloc(sizeof(int));
-    *exit_code = 0;
-
-    get_opts(argc, argv, get_threadnum, get_optind);
-    struct thread_job* thread_job = create_thread_job(argc, argv, *get_threadnum, *get_optind, exit_code);
-    free(get_optind);
-    free(get_threadnum);
-
     pthread_t threads[thread_job->num_threads];
+    struct thread_arg args[thread_job->num_threads];
     for (int i = 0; i < thread_job->num_threads; i++) // loop and make threads
     {
-        if (pthread_create(&threads[i], NULL, &thread_loop, (void*) thread_job) != 0) // create threads
+        args[i].thread_job = thread_job;
+        args[i].id = i;
+        if (pthread_create(&threads[i], NULL, &thread_loop, (void*) &args[i]) != 0) // create threads
         {
             perror("failed to creat thread\n");
             exit(EXIT_FAILURE);
@@ -176,15 +296,27 @@ int main(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
     }
+}
 
+/**
+ * frees a thread_job and its targets, but not the exit_code it points to
+ * 
+ * @param thread_job     the thread_job to free
+ * @return      void
+ */
+void free_thread_job(struct thread_job* thread_job)
+{
     for (int i = 0; i < thread_job->num_targets; i++) // clean up
     {
+        target_closespill(&thread_job->targets[i]);
+        for (int j = 0; j <= thread_job->targets[i].path_head; j++) // snapshots never pop the starting path
+        {
+            free(thread_job->targets[i].path_list[j]);
+        }
         free(thread_job->targets[i].target);
         free(thread_job->targets[i].path_list);
     }
 
-    int result = *exit_code; // valgrind workaround, and cleanup
-    free(exit_code);
     pthread_mutex_destroy(&thread_job->threadsLock);
     pthread_mutex_destroy(&thread_job->exitLock);
     pthread_mutex_destroy(&thread_job->targetsLock);
@@ -193,10 +325,291 @@ int main(int argc, char **argv)
         perror("failed to destory semaphore");
         exit(EXIT_FAILURE);
     }
-    
-    ;
     free(thread_job->targets);
+    free(thread_job->slots);
     free(thread_job);
+}
 
+/**
+ * walks the targets into a snapshot with the threads, then prints the totals like the threads do
+ * the snapshot threads are separate from the pool since the snapshot has to be written in sorted DFS order
+ * 
+ * @param thread_job     the thread_job holding the targets
+ * @param file     path of the snapshot to write
+ * @return      void
+ */
+void snapshot_targets(struct thread_job* thread_job, const char* file)
+{
+    struct snap_writer writer;
+    snap_writer_open(&writer, file, thread_job->exit_code);
+    snap_targets(&writer, thread_job->targets, thread_job->num_targets, thread_job->num_threads, thread_job->trace);
+    for (int i = 0; i < thread_job->num_targets; i++)
+    {
+        struct target* target = &thread_job->targets[i];
+        metrics_print(&target->target_metrics, thread_job->show, target->target);
+    }
+    snap_writer_close(&writer);
+}
+
+/**
+ * scans the directories the watch has queued with the threads, recording them into the watch
+ * paths that are gone or have become links by now are skipped, and ones that are there twice are only scanned once
+ * 
+ * @param watch     the watch to scan for
+ * @param parent     the thread_job of the first scan, its targets, number of threads, trace and memory cap are used
+ * @return      void
+ */
+void watch_scan(struct watch* watch, struct thread_job* parent)
+{
+    char** paths = haz_malloc(sizeof(char*) * (watch->num_created + 1));
+    int num_paths = 0;
+    if (watch->num_created > 0)
+    {
+        qsort(watch->created, watch->num_created, sizeof(char*), watch_compare);
+    }
+    for (size_t i = 0; i < watch->num_created; i++)
+    {
+        struct stat file;
+        bool skip = (num_paths > 0 && strcmp(paths[num_paths - 1], watch->created[i]) == 0) || lstat(watch->created[i], &file) != 0;
+        bool link = !skip && S_ISLNK(file.st_mode); // replaced since its event, unless it's a target being scanned again
+        for (int j = 0; link && j < parent->num_targets; j++)
+        {
+            link = strcmp(parent->targets[j].target, watch->created[i]) != 0;
+        }
+        if (skip || link)
+        {
+            free(watch->created[i]);
+            continue;
+        }
+        paths[num_paths++] = watch->created[i];
+    }
+    paths[num_paths] = NULL;
+    watch->num_created = 0;
+
+    if (num_paths > 0)
+    {
+        struct thread_job* thread_job = create_thread_job(num_paths, paths, parent->num_threads, 0, watch->exit_code);
+        thread_job->watch = watch;
+        thread_job->quiet = true;
+        thread_job->trace = parent->trace;
+        thread_job->target_mem = parent->target_mem;
+        run_threads(thread_job);
+        free_thread_job(thread_job);
+    }
+    for (int i = 0; i < num_paths; i++)
+    {
+        free(paths[i]);
+    }
+    free(paths);
+    watch_link(watch);
+}
+
+/**
+ * brings the totals up to date with what happened since the last tick, and prints them if they changed
+ * after an overflow the events that were lost can't be known, so the roots are scanned again
+ * 
+ * @param watch     the watch
+ * @param thread_job     the thread_job of the first scan, holding the targets
+ * @param printed     the totals printed last time, one per target
+ * @return      void
+ */
+void watch_tick(struct watch* watch, struct thread_job* thread_job, struct metrics* printed)
+{
+    if (watch->overflow)
+    {
+        fprintf(stderr, "event queue overflowed, scanning again\n");
+        for (int i = 0; i < thread_job->num_targets; i++)
+        {
+            char* path = thread_job->targets[i].target;
+            struct watch_dir* root = watch_table_find(&watch->paths, path, strlen(path));
+            if (root != NULL)
+            {
+                watch_remove(watch, root);
+            }
+            watch->created = haz_append(watch->created, &watch->num_created, &watch->created_size, sizeof(char*));
+            watch->created[watch->num_created - 1] = haz_strdup(path);
+        }
+        watch->overflow = false;
+    }
+    watch_scan(watch, thread_job);
+
+    for (size_t i = 0; i < watch->num_dirty; i++)
+    {
+        if (watch->dirty[i] != NULL) // NULL if it was removed after it got dirty
+        {
+            watch_restat(watch->dirty[i]);
+            watch->dirty[i]->dirty = false;
+        }
+    }
+    watch->num_dirty = 0;
+
+    bool changed = false;
+    for (int i = 0; i < thread_job->num_targets; i++)
+    {
+        char* path = thread_job->targets[i].target;
+        struct watch_dir* root = watch_table_find(&watch->paths, path, strlen(path));
+        struct metrics total;
+        metrics_zero(&total);
+        if (root != NULL)
+        {
+            total = root->total;
+        }
+        if (memcmp(&total, &printed[i], sizeof(struct metrics)) != 0)
+        {
+            printed[i] = total;
+            changed = true;
+        }
+    }
+    if (changed)
+    {
+        for (int i = 0; i < thread_job->num_targets; i++)
+        {
+            metrics_print(&printed[i], thread_job->show, thread_job->targets[i].target);
+        }
+        fflush(stdout);
+    }
+}
+
+/**
+ * keeps the totals of the targets current after the first scan, until interrupted
+ * events are read as they come, the work is done once every interval
+ * 
+ * @param watch     the watch the first scan recorded into
+ * @param thread_job     the thread_job of the first scan
+ * @return      void
+ */
+void watch_targets(struct watch* watch, struct thread_job* thread_job)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = watch_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    watch_link(watch);
+    struct metrics* printed = haz_malloc(sizeof(struct metrics) * thread_job->num_targets);
+    for (int i = 0; i < thread_job->num_targets; i++)
+    {
+        printed[i] = thread_job->targets[i].target_metrics; // already printed by the threads
+    }
+    fflush(stdout);
+
+    char* buffer = haz_malloc(WATCH_EVENTS);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    time_t next = now.tv_sec + watch->interval;
+    while (!watch_stopped)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec >= next)
+        {
+            watch_tick(watch, thread_job, printed);
+            next = now.tv_sec + watch->interval;
+            continue;
+        }
+
+        struct pollfd poll_fd = {watch->fd, POLLIN, 0};
+        int ready = poll(&poll_fd, 1, (int)((next - now.tv_sec) * 1000 - now.tv_nsec / 1000000));
+        if (ready < 0 && errno != EINTR)
+        {
+            perror("poll failed");
+            exit(EXIT_FAILURE);
+        }
+        if (ready > 0)
+        {
+            ssize_t length = read(watch->fd, buffer, WATCH_EVENTS);
+            if (length < 0 && errno != EINTR && errno != EAGAIN)
+            {
+                perror("failed to read events");
+                exit(EXIT_FAILURE);
+            }
+            if (length > 0 && watch->fanotify)
+            {
+                watch_read_fanotify(watch, buffer, length);
+            }
+            else if (length > 0)
+            {
+                watch_read_inotify(watch, buffer, length);
+            }
+        }
+    }
+    free(buffer);
+    free(printed);
+}
+
+/**
+ * main of mdu, runs the program. Cleans up everything before it quits.
+ * 
+ * @param argc     the argc the program got at start
+ * @param argv     pointer of argv the program got at start
+ * @return      a pointer to the thread_job that it created
+ */
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "query") == 0) // a directory with this name has to be given as ./query, same for diff
+    {
+        return query_main(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "diff") == 0)
+    {
+        return diff_main(argc - 1, argv + 1);
+    }
+
+    int* exit_code = haz_malloc(sizeof(int));
+    struct mdu_opts opts;
+    *exit_code = 0;
+
+    get_opts(argc, argv, &opts);
+    struct thread_job* thread_job = create_thread_job(argc, argv, opts.threadnum, opts.optind, exit_code);
+    thread_job->show = opts.show;
+    if (opts.max_mem > 0) // split between the targets the threads have, the shared one only holds a couple of paths per thread
+    {
+        thread_job->target_mem = opts.max_mem / (size_t)opts.threadnum;
+        thread_job->target_mem = thread_job->target_mem > 0 ? thread_job->target_mem : 1;
+    }
+    struct trace trace;
+    if (opts.trace != NULL)
+    {
+        trace_init(&trace, opts.trace, opts.threadnum);
+        thread_job->trace = &trace;
+    }
+
+    if (opts.snapshot != NULL)
+    {
+        snapshot_targets(thread_job, opts.snapshot);
+    }
+    else if (opts.watch)
+    {
+        struct watch watch;
+        watch_init(&watch, opts.interval, exit_code);
+        thread_job->watch = &watch;
+        run_threads(thread_job);
+        watch_targets(&watch, thread_job);
+        watch_destroy(&watch);
+    }
+    else if (thread_job->num_targets > 1 || opts.follow) // with one target and no -L there's no loop to catch or total to reuse, bind mounts are counted at every path
+    {
+        struct visit_set visit;
+        visit_init(&visit, thread_job->num_targets > 1, opts.show);
+        thread_job->visit = &visit;
+        thread_job->follow = opts.follow;
+        job_start_target(thread_job);
+        run_threads(thread_job);
+        visit_destroy(&visit);
+    }
+    else
+    {
+        run_threads(thread_job);
+    }
+    free_thread_job(thread_job);
+    if (opts.trace != NULL)
+    {
+        trace_write(&trace);
+        trace_destroy(&trace);
+    }
+
+    int result = *exit_code; // valgrind workaround, and cleanup
+    free(exit_code);
     return result;
 }
\ No newline at end of file
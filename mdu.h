@@ -1,14 +1,39 @@
 #pragma once
 #include "target.h"
 #include "jobber.h"
+#include "snapshot.h"
+#include "query.h"
+#include "diff.h"
 #include <semaphore.h>
 #include <pthread.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+// options given on the command line
+struct mdu_opts{
+    int threadnum;
+    int optind;
+    char* snapshot;
+    bool watch;
+    int interval;
+    int show; // METRIC_ flags
+    char* trace;
+    size_t max_mem; // bytes the pending paths may take, 0 for no limit
+    bool follow; // -L, the targets themselves are always followed
+};
 
 void haz_mutex_init(pthread_mutex_t* mutex);
-void get_opts(int argc, char** argv, int* get_threadnum, int* get_optind);
+size_t parse_size(const char* arg);
+void get_opts(int argc, char** argv, struct mdu_opts* opts);
 struct thread_job* create_thread_job(int argc, char** argv, int threadnum, int set_optind, int* exit_code);
-void* thread_loop(void* arg);
\ No newline at end of file
+void* thread_loop(void* arg);
+void run_threads(struct thread_job* thread_job);
+void free_thread_job(struct thread_job* thread_job);
+void snapshot_targets(struct thread_job* thread_job, const char* file);
+void watch_scan(struct watch* watch, struct thread_job* parent);
+void watch_tick(struct watch* watch, struct thread_job* thread_job, struct metrics* printed);
+void watch_targets(struct watch* watch, struct thread_job* thread_job);
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "metrics.h"
+
+/**
+ * sets all the metrics to zero
+ *
+ * @param metrics     the metrics to clear
+ * @return      void
+ */
+void metrics_zero(struct metrics* metrics)
+{
+    memset(metrics, 0, sizeof(struct metrics));
+}
+
+/**
+ * counts one file into the metrics
+ *
+ * @param metrics     the metrics to add to
+ * @param file     the lstat of the file
+ * @return      void
+ */
+void metrics_stat(struct metrics* metrics, const struct stat* file)
+{
+    metrics->blocks += file->st_blocks;
+    metrics->bytes += file->st_size;
+    metrics->inodes++;
+    if (S_ISREG(file->st_mode))
+    {
+        metrics->files++;
+    }
+    else if (S_ISDIR(file->st_mode))
+    {
+        metrics->dirs++;
+    }
+    else if (S_ISLNK(file->st_mode))
+    {
+        metrics->links++;
+    }
+    else
+    {
+        metrics->others++;
+    }
+}
+
+/**
+ * adds one set of metrics to another
+ *
+ * @param to     the metrics to add to
+ * @param from     the metrics to add
+ * @return      void
+ */
+void metrics_add(struct metrics* to, const struct metrics* from)
+{
+    to->blocks += from->blocks;
+    to->bytes += from->bytes;
+    to->inodes += from->inodes;
+    to->files += from->files;
+    to->dirs += from->dirs;
+    to->links += from->links;
+    to->others += from->others;
+}
+
+/**
+ * subtracts one set of metrics from another
+ *
+ * @param to     the metrics to subtract from
+ * @param from     the metrics to subtract
+ * @return      void
+ */
+void metrics_sub(struct metrics* to, const struct metrics* from)
+{
+    to->blocks -= from->blocks;
+    to->bytes -= from->bytes;
+    to->inodes -= from->inodes;
+    to->files -= from->files;
+    to->dirs -= from->dirs;
+    to->links -= from->links;
+    to->others -= from->others;
+}
+
+/**
+ * prints the chosen metrics and the path on one line, tab separated like du
+ *
+ * @param metrics     the metrics to print
+ * @param show     the METRIC_ flags to print
+ * @param path     the path they belong to
+ * @return      void
+ */
+void metrics_print(const struct metrics* metrics, int show, const char* path)
+{
+    if (show & METRIC_BLOCKS)
+    {
+        printf("%" PRId64 "\t", metrics->blocks);
+    }
+    if (show & METRIC_BYTES)
+    {
+        printf("%" PRId64 "\t", metrics->bytes);
+    }
+    if (show & METRIC_INODES)
+    {
+        printf("%" PRId64 "\t", metrics->inodes);
+    }
+    if (show & METRIC_TYPES)
+    {
+        printf("%" PRId64 " files\t%" PRId64 " dirs\t%" PRId64 " links\t%" PRId64 " other\t", metrics->files, metrics->dirs, metrics->links, metrics->others);
+    }
+    printf("%s\n", path);
+}
\ No newline at end of file
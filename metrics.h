@@ -0,0 +1,29 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// which metrics to print, more than one prints them in this order
+#define METRIC_BLOCKS 1
+#define METRIC_BYTES 2
+#define METRIC_INODES 4
+#define METRIC_TYPES 8
+
+// everything that is counted about the files, all of it comes from the same lstat
+struct metrics{
+    int64_t blocks; // 512 byte blocks
+    int64_t bytes; // apparent size
+    int64_t inodes;
+    int64_t files;
+    int64_t dirs;
+    int64_t links;
+    int64_t others;
+};
+void metrics_zero(struct metrics* metrics);
+void metrics_stat(struct metrics* metrics, const struct stat* file);
+void metrics_add(struct metrics* to, const struct metrics* from);
+void metrics_sub(struct metrics* to, const struct metrics* from);
+void metrics_print(const struct metrics* metrics, int show, const char* path);
\ No newline at end of file
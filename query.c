@@ -0,0 +1,224 @@
+#include "query.h"
+
+/**
+ * prints how mdu query is used
+ *
+ * @return      void
+ */
+void query_usage(void)
+{
+    fprintf(stderr, "usage: mdu query FILE [path] [-d N] [--top N] [-b | --apparent-size | --inodes | --blocks]\n");
+}
+
+/**
+ * prints the size of a node and of its subdirectories down to max_depth, subdirectories first like du does
+ * the end of the node has to have been checked with snap_end already
+ *
+ * @param map     the snapshot
+ * @param index     index of the node
+ * @param path     path of the node
+ * @param depth     how far below the queried node this node is
+ * @param max_depth     how deep to print
+ * @return      void
+ */
+void query_print(const struct snap_map* map, uint64_t index, char* path, int depth, int max_depth)
+{
+    if (depth < max_depth)
+    {
+        uint64_t end = map->nodes[index].end; // checked by whoever found index
+        uint64_t next;
+        for (uint64_t child = index + 1; child < end; child = next)
+        {
+            next = snap_end(map, child, end); // before going down, so nothing below a corrupt node is printed
+            char* child_path = target_appendstr(haz_strdup(path), snap_name(map, child));
+            query_print(map, child, child_path, depth + 1, max_depth);
+            free(child_path);
+        }
+    }
+    printf("%" PRIu64 "\t%s\n", snap_size(map, index), path);
+}
+
+/**
+ * gives the score of a query entry for the heap
+ *
+ * @param entry     pointer to the entry
+ * @return      its size
+ */
+double query_score(const void* entry)
+{
+    return (double)((const struct query_entry*)entry)->size;
+}
+
+/**
+ * compares two heap entries for qsort, largest first
+ *
+ * @param a     pointer to the first entry
+ * @param b     pointer to the second entry
+ * @return      <0, 0 or >0
+ */
+int query_compare(const void* a, const void* b)
+{
+    const struct query_entry* first = a;
+    const struct query_entry* second = b;
+    if (first->size != second->size)
+    {
+        return first->size < second->size ? 1 : -1;
+    }
+    return first->index < second->index ? -1 : (first->index > second->index);
+}
+
+/**
+ * prints the largest directories of a node, or of the whole snapshot
+ * goes straight through the node array, paths are only built for the ones that are printed
+ *
+ * @param map     the snapshot
+ * @param start     index of the node, or SNAP_NONE for the whole snapshot
+ * @param max_depth     how deep to look, or -1 for no limit
+ * @param max     how many directories to print
+ * @return      void
+ */
+void query_top(const struct snap_map* map, uint64_t start, int max_depth, size_t max)
+{
+    uint64_t limit = map->header->num_nodes;
+    uint64_t first = 0;
+    if (start != SNAP_NONE)
+    {
+        first = start;
+        limit = snap_end(map, start, limit);
+    }
+
+    struct top heap;
+    top_init(&heap, max, sizeof(struct query_entry), query_score);
+    size_t ends_size = 64;
+    size_t depth = 0;
+    uint64_t* ends = haz_malloc(sizeof(uint64_t) * ends_size); // ends of the nodes above the current one
+
+    for (uint64_t i = first; i < limit;)
+    {
+        while (depth > 0 && ends[depth - 1] <= i)
+        {
+            depth--;
+        }
+        uint64_t end = snap_end(map, i, depth > 0 ? ends[depth - 1] : limit);
+        struct query_entry entry = {snap_size(map, i), i};
+        top_push(&heap, &entry);
+
+        if (max_depth >= 0 && depth >= (size_t)max_depth)
+        {
+            i = end;
+            continue;
+        }
+        if (depth == ends_size)
+        {
+            ends_size += ends_size;
+            ends = haz_realloc(ends, sizeof(uint64_t) * ends_size);
+        }
+        ends[depth++] = end;
+        i++;
+    }
+
+    top_sort(&heap, query_compare);
+    for (size_t i = 0; i < heap.num; i++)
+    {
+        const struct query_entry* kept = top_entry(&heap, i);
+        char* path = snap_path(map, kept->index);
+        printf("%" PRIu64 "\t%s\n", kept->size, path);
+        free(path);
+    }
+    free(ends);
+    top_free(&heap);
+}
+
+/**
+ * runs mdu query, answers questions about a snapshot written with --snapshot
+ *
+ * @param argc     the argc after the "query" word
+ * @param argv     the argv starting at the "query" word
+ * @return      the exit code
+ */
+int query_main(int argc, char** argv)
+{
+    static struct option long_options[] = {
+        {"depth", required_argument, NULL, 'd'},
+        {"top", required_argument, NULL, 't'},
+        {"apparent-size", no_argument, NULL, 'b'},
+        {"inodes", no_argument, NULL, 'I'},
+        {"blocks", no_argument, NULL, 'B'},
+        {NULL, 0, NULL, 0}
+    };
+    int metric = METRIC_BLOCKS;
+    int max_depth = -1;
+    long top = 0;
+    int argnum;
+    while ((argnum = getopt_long(argc, argv, "d:t:b", long_options, NULL)) != -1)
+    {
+        if (snap_metric_opt(argnum) != 0)
+        {
+            metric = snap_metric_opt(argnum);
+        }
+        else if (argnum == 'd')
+        {
+            max_depth = atoi(optarg);
+            if (max_depth < 0)
+            {
+                fprintf(stderr, "depth can't be negative\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (argnum == 't')
+        {
+            top = atol(optarg);
+            if (top < 1)
+            {
+                fprintf(stderr, "--top needs at least 1\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            query_usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc || argc - optind > 2)
+    {
+        query_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    struct snap_map map;
+    snap_map_open(&map, argv[optind]);
+    map.metric = metric;
+    uint64_t start = SNAP_NONE;
+    if (argc - optind == 2 && (start = snap_lookup(&map, argv[optind + 1])) == SNAP_NONE)
+    {
+        fprintf(stderr, "%s is not in the snapshot\n", argv[optind + 1]);
+        snap_map_close(&map);
+        return EXIT_FAILURE;
+    }
+
+    if (top > 0)
+    {
+        query_top(&map, start, max_depth, (size_t)top);
+    }
+    else if (start != SNAP_NONE)
+    {
+        char* path = snap_path(&map, start);
+        query_print(&map, start, path, 0, max_depth < 0 ? 0 : max_depth);
+        free(path);
+    }
+    else
+    {
+        uint64_t num_nodes = map.header->num_nodes;
+        uint64_t next;
+        for (uint64_t root = 0; root < num_nodes; root = next)
+        {
+            next = snap_end(&map, root, num_nodes);
+            char* path = haz_strdup((char*)snap_name(&map, root));
+            query_print(&map, root, path, 0, max_depth < 0 ? 0 : max_depth);
+            free(path);
+        }
+    }
+    snap_map_close(&map);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include "snapshot.h"
+#include "top.h"
+
+// an entry in the --top heap
+struct query_entry{
+    uint64_t size;
+    uint64_t index;
+};
+
+void query_usage(void);
+void query_print(const struct snap_map* map, uint64_t index, char* path, int depth, int max_depth);
+double query_score(const void* entry);
+int query_compare(const void* a, const void* b);
+void query_top(const struct snap_map* map, uint64_t start, int max_depth, size_t max);
+int query_main(int argc, char** argv);
\ No newline at end of file
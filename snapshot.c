@@ -0,0 +1,932 @@
+#include "snapshot.h"
+
+/**
+ * hazardous pwrite, writes the whole buffer or kills the program
+ *
+ * @param fd     file descriptor to write to
+ * @param buffer     the data to write
+ * @param size     number of bytes to write
+ * @param offset     where in the file to write
+ * @return      void
+ */
+void haz_pwrite(int fd, const void* buffer, size_t size, uint64_t offset)
+{
+    const char* data = buffer;
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, data, size, (off_t)offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("failed to write snapshot");
+            exit(EXIT_FAILURE);
+        }
+        data += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+}
+
+/**
+ * adds a name to the string table, names that have been seen before are reused
+ *
+ * @param writer     the writer to add the name to
+ * @param name     the name to add
+ * @return      offset of the name in the string table
+ */
+uint64_t snap_addname(struct snap_writer* writer, const char* name)
+{
+    uint64_t hash = target_hash(name, strlen(name));
+    struct snap_name* slot = NULL;
+    if (writer->names != NULL && writer->names_used < (SNAP_NAMES / 4) * 3) // the table only holds so much, after that names are stored as they come
+    {
+        size_t i = (size_t)(hash & (SNAP_NAMES - 1));
+        while (writer->names[i].name != NULL)
+        {
+            if (writer->names[i].hash == hash && strcmp(writer->names[i].name, name) == 0)
+            {
+                return writer->names[i].offset;
+            }
+            i = (i + 1) & (SNAP_NAMES - 1);
+        }
+        slot = &writer->names[i];
+    }
+
+    size_t length = strlen(name) + 1;
+    uint64_t offset = writer->strings_size;
+    if (fwrite(name, 1, length, writer->strings) != length)
+    {
+        perror("failed to write snapshot strings");
+        exit(EXIT_FAILURE);
+    }
+    writer->strings_size += length;
+
+    if (slot != NULL)
+    {
+        slot->hash = hash;
+        slot->offset = offset;
+        slot->name = haz_strdup((char*)name);
+        writer->names_used++;
+    }
+    return offset;
+}
+
+/**
+ * writes out the buffered nodes, nodes that are still open are written again once they close
+ *
+ * @param writer     the writer to flush
+ * @return      void
+ */
+void snap_flush_nodes(struct snap_writer* writer)
+{
+    haz_pwrite(writer->fd, writer->buffer, sizeof(struct snap_node) * writer->buffer_num,
+               sizeof(struct snap_header) + writer->buffer_base * sizeof(struct snap_node));
+    writer->buffer_base += writer->buffer_num;
+    writer->buffer_num = 0;
+}
+
+/**
+ * adds a new node in DFS order, its metrics and end are filled in by snap_close_node
+ *
+ * @param writer     the writer to add the node to
+ * @param name     the name of the directory
+ * @return      the index of the node
+ */
+uint64_t snap_push_node(struct snap_writer* writer, const char* name)
+{
+    if (writer->buffer_num == SNAP_BUFFER)
+    {
+        snap_flush_nodes(writer);
+    }
+    struct snap_node* node = &writer->buffer[writer->buffer_num++];
+    node->blocks = 0;
+    node->bytes = 0;
+    node->inodes = 0;
+    node->end = 0;
+    node->name = snap_addname(writer, name);
+    return writer->num_nodes++;
+}
+
+/**
+ * closes a node once its whole subtree has been written
+ *
+ * @param writer     the writer the node belongs to
+ * @param index     index of the node
+ * @param metrics     the metrics of the subtree
+ * @return      void
+ */
+void snap_close_node(struct snap_writer* writer, uint64_t index, const struct metrics* metrics)
+{
+    if (index >= writer->buffer_base)
+    {
+        struct snap_node* node = &writer->buffer[index - writer->buffer_base];
+        node->blocks = (uint64_t)metrics->blocks;
+        node->bytes = (uint64_t)metrics->bytes;
+        node->inodes = (uint64_t)metrics->inodes;
+        node->end = writer->num_nodes;
+    }
+    else // already on disk, only the metrics and end have to be patched
+    {
+        uint64_t patch[4] = {(uint64_t)metrics->blocks, (uint64_t)metrics->bytes, (uint64_t)metrics->inodes, writer->num_nodes};
+        haz_pwrite(writer->fd, patch, sizeof(patch), sizeof(struct snap_header) + index * sizeof(struct snap_node));
+    }
+}
+
+/**
+ * opens a snapshot file for writing
+ *
+ * @param writer     the writer to set up
+ * @param file     path of the snapshot file
+ * @param exit_code     exit code of the program, set to 1 when something can't be read
+ * @return      void
+ */
+void snap_writer_open(struct snap_writer* writer, const char* file, int* exit_code)
+{
+    if ((writer->fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+    {
+        fprintf(stderr, "failed to open snapshot %s: ", file);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+    if ((writer->strings = tmpfile()) == NULL)
+    {
+        perror("failed to create snapshot string table");
+        exit(EXIT_FAILURE);
+    }
+    if ((writer->names = calloc(SNAP_NAMES, sizeof(struct snap_name))) == NULL)
+    {
+        fprintf(stderr, "failed to allocate space");
+        exit(EXIT_FAILURE);
+    }
+    writer->strings_size = 0;
+    writer->names_used = 0;
+    writer->buffer = haz_malloc(sizeof(struct snap_node) * SNAP_BUFFER);
+    writer->buffer_base = 0;
+    writer->buffer_num = 0;
+    writer->num_nodes = 0;
+    writer->num_roots = 0;
+    writer->exit_code = exit_code;
+}
+
+/**
+ * writes out the remaining nodes, the string table and the header, then closes the snapshot
+ *
+ * @param writer     the writer to close
+ * @return      void
+ */
+void snap_writer_close(struct snap_writer* writer)
+{
+    snap_flush_nodes(writer);
+
+    struct snap_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+    header.version = SNAP_VERSION;
+    header.node_size = sizeof(struct snap_node);
+    header.num_nodes = writer->num_nodes;
+    header.num_roots = writer->num_roots;
+    header.strings_offset = sizeof(struct snap_header) + writer->num_nodes * sizeof(struct snap_node);
+    header.strings_size = writer->strings_size;
+
+    char chunk[65536];
+    size_t read;
+    uint64_t offset = header.strings_offset;
+    rewind(writer->strings);
+    while ((read = fread(chunk, 1, sizeof(chunk), writer->strings)) > 0)
+    {
+        haz_pwrite(writer->fd, chunk, read, offset);
+        offset += read;
+    }
+    if (ferror(writer->strings))
+    {
+        perror("failed to read snapshot strings");
+        exit(EXIT_FAILURE);
+    }
+    haz_pwrite(writer->fd, &header, sizeof(header), 0);
+
+    if (close(writer->fd) != 0)
+    {
+        perror("failed to close snapshot");
+        exit(EXIT_FAILURE);
+    }
+    fclose(writer->strings);
+    for (size_t i = 0; i < SNAP_NAMES; i++)
+    {
+        free(writer->names[i].name);
+    }
+    free(writer->names);
+    free(writer->buffer);
+}
+
+/**
+ * prints an error for a path that couldn't be read, and marks the exit code
+ *
+ * @param writer     the writer that is walking
+ * @param message     what went wrong
+ * @param path     the path it went wrong at
+ * @return      void
+ */
+void snap_error(struct snap_writer* writer, const char* message, const char* path)
+{
+    fprintf(stderr, "%s %s: ", message, path);
+    perror("");
+    *writer->exit_code = 1;
+}
+
+/**
+ * compares two names for qsort, children are stored in this order
+ *
+ * @param a     pointer to the first char*
+ * @param b     pointer to the second char*
+ * @return      <0, 0 or >0 like strcmp
+ */
+int snap_compare(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * counts a directory and the files in it, and lists its subdirectories sorted by name
+ *
+ * @param writer     the writer errors are reported through
+ * @param path     path to the directory
+ * @param metrics     where to add the directory and its files
+ * @param dirs     set to the names of the subdirectories, NULL if there are none
+ * @param num_dirs     set to the number of subdirectories
+ * @return      false if the path couldn't be lstated
+ */
+bool snap_list(struct snap_writer* writer, char* path, struct metrics* metrics, char*** dirs, size_t* num_dirs)
+{
+    *dirs = NULL;
+    *num_dirs = 0;
+    struct stat file;
+    uint64_t trace_start = trace_begin();
+    if (lstat(path, &file) != 0)
+    {
+        trace_end(TRACE_STAT, trace_start);
+        snap_error(writer, "lstat failed at", path);
+        return false;
+    }
+    struct stat linked;
+    if (S_ISLNK(file.st_mode) && stat(path, &linked) == 0 && S_ISDIR(linked.st_mode)) // a target that links to a directory is read like job_do's opendir reads it, other links count as themselves
+    {
+        file = linked;
+    }
+    trace_end(TRACE_STAT, trace_start);
+    metrics_stat(metrics, &file);
+    if (!S_ISDIR(file.st_mode)) // a file given as a target only has its own size
+    {
+        return true;
+    }
+
+    DIR* d;
+    trace_start = trace_begin();
+    if ((d = opendir(path)) == NULL)
+    {
+        trace_end(TRACE_READDIR, trace_start);
+        snap_error(writer, "failed to open directory", path);
+        return true;
+    }
+    size_t dirs_size = 0;
+    struct dirent* dir;
+    errno = 0;
+    while ((dir = readdir(d)) != NULL)
+    {
+        if (strcmp(dir->d_name, ".") != 0 && strcmp(dir->d_name, "..") != 0)
+        {
+            bool is_dir = dir->d_type == DT_DIR;
+            if (!is_dir)
+            {
+                uint64_t stat_start = trace_begin();
+                int stated = fstatat(dirfd(d), dir->d_name, &file, AT_SYMLINK_NOFOLLOW);
+                trace_end(TRACE_STAT, stat_start);
+                if (stated != 0)
+                {
+                    snap_error(writer, "lstat failed in", path);
+                }
+                else if (S_ISDIR(file.st_mode)) // d_type was unknown
+                {
+                    is_dir = true;
+                }
+                else
+                {
+                    metrics_stat(metrics, &file);
+                }
+            }
+            if (is_dir)
+            {
+                *dirs = haz_append(*dirs, num_dirs, &dirs_size, sizeof(char*));
+                (*dirs)[*num_dirs - 1] = haz_strdup(dir->d_name);
+            }
+        }
+        errno = 0;
+    }
+    if (errno != 0)
+    {
+        snap_error(writer, "readdir error at", path);
+    }
+    if (closedir(d) != 0)
+    {
+        perror("closedir failed");
+        exit(EXIT_FAILURE);
+    }
+    trace_end(TRACE_READDIR, trace_start);
+    if (*num_dirs > 0)
+    {
+        qsort(*dirs, *num_dirs, sizeof(char*), snap_compare);
+    }
+    return true;
+}
+
+/**
+ * walks a directory in sorted DFS order and streams it to the snapshot
+ * the subdirectories of a directory are read before any of them are entered, so only one directory is open at a time
+ *
+ * @param writer     the writer to write to
+ * @param path     path to the directory
+ * @param name     the name to store for the directory
+ * @param metrics     where to add the directory and everything in it
+ * @return      void
+ */
+void snap_walk(struct snap_writer* writer, char* path, const char* name, struct metrics* metrics)
+{
+    uint64_t index = snap_push_node(writer, name);
+    struct metrics subtree;
+    metrics_zero(&subtree);
+
+    char** dirs;
+    size_t num_dirs;
+    snap_list(writer, path, &subtree, &dirs, &num_dirs);
+    for (size_t i = 0; i < num_dirs; i++)
+    {
+        char* child_path = target_appendstr(haz_strdup(path), dirs[i]);
+        snap_walk(writer, child_path, dirs[i], &subtree);
+        free(child_path);
+        free(dirs[i]);
+    }
+    free(dirs);
+
+    snap_close_node(writer, index, &subtree);
+    metrics_add(metrics, &subtree);
+}
+
+/**
+ * opens a fragment, a writer to temporary files that one thread walks its subtrees into
+ * names aren't deduplicated, so they are in the same order as the nodes
+ *
+ * @param writer     the writer to set up
+ * @param exit_code     exit code of the thread
+ * @return      void
+ */
+void snap_fragment_open(struct snap_writer* writer, int* exit_code)
+{
+    FILE* nodes;
+    if ((nodes = tmpfile()) == NULL || (writer->fd = dup(fileno(nodes))) < 0 || (writer->strings = tmpfile()) == NULL)
+    {
+        perror("failed to create snapshot fragment");
+        exit(EXIT_FAILURE);
+    }
+    fclose(nodes); // the file stays until the dup is closed
+    writer->strings_size = 0;
+    writer->names = NULL;
+    writer->names_used = 0;
+    writer->buffer = haz_malloc(sizeof(struct snap_node) * SNAP_BUFFER);
+    writer->buffer_base = 0;
+    writer->buffer_num = 0;
+    writer->num_nodes = 0;
+    writer->num_roots = 0;
+    writer->exit_code = exit_code;
+}
+
+/**
+ * closes a fragment, its files go away with it
+ *
+ * @param writer     the fragment
+ * @return      void
+ */
+void snap_fragment_close(struct snap_writer* writer)
+{
+    close(writer->fd);
+    fclose(writer->strings);
+    free(writer->buffer);
+}
+
+/**
+ * reads a directory on the main thread so its subdirectories can be walked by different threads
+ *
+ * @param writer     the writer errors are reported through
+ * @param plan     the directory to expand
+ * @return      void
+ */
+void snap_expand(struct snap_writer* writer, struct snap_plan* plan)
+{
+    char** dirs;
+    size_t num_dirs;
+    plan->expanded = true;
+    snap_list(writer, plan->path, &plan->metrics, &dirs, &num_dirs);
+    plan->children = num_dirs > 0 ? haz_malloc(sizeof(struct snap_plan) * num_dirs) : NULL;
+    plan->num_children = num_dirs;
+    for (size_t i = 0; i < num_dirs; i++)
+    {
+        struct snap_plan* child = &plan->children[i];
+        child->path = target_appendstr(haz_strdup(plan->path), dirs[i]);
+        child->name = dirs[i];
+        metrics_zero(&child->metrics);
+        child->expanded = false;
+        child->children = NULL;
+        child->num_children = 0;
+    }
+    free(dirs);
+}
+
+/**
+ * the loop the snapshot threads run, takes subtrees until there are none left and walks them into its fragment
+ *
+ * @param arg     a struct snap_arg
+ * @return      NULL
+ */
+void* snap_worker(void* arg)
+{
+    struct snap_pool* pool = ((struct snap_arg*)arg)->pool;
+    int id = ((struct snap_arg*)arg)->id;
+    struct snap_writer* fragment = &pool->fragments[id];
+    trace_attach(pool->trace, id);
+    while (true)
+    {
+        pthread_mutex_lock(&pool->lock);
+        struct snap_plan* plan = pool->next < pool->num_tasks ? pool->tasks[pool->next++] : NULL;
+        pthread_mutex_unlock(&pool->lock);
+        if (plan == NULL)
+        {
+            break;
+        }
+        plan->thread = id;
+        plan->start = fragment->num_nodes;
+        plan->strings_start = fragment->strings_size;
+        snap_walk(fragment, plan->path, plan->name, &plan->metrics);
+        plan->count = fragment->num_nodes - plan->start;
+    }
+    snap_flush_nodes(fragment);
+    if (fflush(fragment->strings) != 0)
+    {
+        perror("failed to write snapshot fragment");
+        exit(EXIT_FAILURE);
+    }
+    return NULL;
+}
+
+/**
+ * copies the nodes of a walked subtree from its fragment, moving their ends and names over to the snapshot
+ *
+ * @param writer     the snapshot
+ * @param fragment     the fragment the subtree is in
+ * @param plan     the subtree
+ * @return      void
+ */
+void snap_copy(struct snap_writer* writer, struct snap_writer* fragment, const struct snap_plan* plan)
+{
+    uint64_t shift = writer->num_nodes - plan->start;
+    struct snap_node nodes[256];
+    size_t name_size = 256;
+    char* name = haz_malloc(name_size);
+    if (fseeko(fragment->strings, (off_t)plan->strings_start, SEEK_SET) != 0)
+    {
+        perror("failed to read snapshot fragment");
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t done = 0; done < plan->count;)
+    {
+        size_t num = plan->count - done < 256 ? (size_t)(plan->count - done) : 256;
+        size_t want = sizeof(struct snap_node) * num;
+        if (pread(fragment->fd, nodes, want, (off_t)(sizeof(struct snap_header) + (plan->start + done) * sizeof(struct snap_node))) != (ssize_t)want)
+        {
+            perror("failed to read snapshot fragment");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < num; i++)
+        {
+            size_t length = 0;
+            int c;
+            do // names are NUL terminated and in node order
+            {
+                if ((c = getc(fragment->strings)) == EOF)
+                {
+                    perror("failed to read snapshot fragment");
+                    exit(EXIT_FAILURE);
+                }
+                if (length == name_size)
+                {
+                    name_size *= 2;
+                    name = haz_realloc(name, name_size);
+                }
+                name[length++] = (char)c;
+            } while (c != '\0');
+
+            snap_push_node(writer, name);
+            struct snap_node* node = &writer->buffer[writer->buffer_num - 1];
+            node->blocks = nodes[i].blocks;
+            node->bytes = nodes[i].bytes;
+            node->inodes = nodes[i].inodes;
+            node->end = nodes[i].end + shift;
+        }
+        done += num;
+    }
+    free(name);
+}
+
+/**
+ * writes a planned directory to the snapshot in DFS order, its own node and then its subdirectories
+ *
+ * @param writer     the snapshot
+ * @param pool     the pool that walked the subtrees
+ * @param plan     the directory
+ * @return      void
+ */
+void snap_merge(struct snap_writer* writer, struct snap_pool* pool, struct snap_plan* plan)
+{
+    if (!plan->expanded)
+    {
+        snap_copy(writer, &pool->fragments[plan->thread], plan);
+        return;
+    }
+    uint64_t index = snap_push_node(writer, plan->name);
+    for (size_t i = 0; i < plan->num_children; i++)
+    {
+        snap_merge(writer, pool, &plan->children[i]);
+        metrics_add(&plan->metrics, &plan->children[i].metrics);
+    }
+    snap_close_node(writer, index, &plan->metrics);
+}
+
+/**
+ * frees what a plan holds, but not the plan itself
+ *
+ * @param plan     the plan
+ * @return      void
+ */
+void snap_free_plan(struct snap_plan* plan)
+{
+    for (size_t i = 0; i < plan->num_children; i++)
+    {
+        snap_free_plan(&plan->children[i]);
+    }
+    free(plan->children);
+    free(plan->path);
+    free(plan->name);
+}
+
+/**
+ * writes the targets to a snapshot, their totals end up in their target_metrics
+ * the main thread reads the top of the targets breadth first until there are SNAP_TASKS subtrees per thread,
+ * the threads walk the subtrees into fragments, and the main thread then writes it all in order
+ *
+ * @param writer     the snapshot
+ * @param targets     the targets, in the order they're stored
+ * @param num_targets     number of targets
+ * @param threadnum     number of threads to walk with
+ * @param trace     where the threads record what they do, NULL when not tracing
+ * @return      void
+ */
+void snap_targets(struct snap_writer* writer, struct target* targets, int num_targets, int threadnum, struct trace* trace)
+{
+    trace_attach(trace, 0); // the main thread reads as worker 0 until the threads start, or all of it with one thread
+    if (threadnum == 1) // nothing to split
+    {
+        for (int i = 0; i < num_targets; i++)
+        {
+            snap_walk(writer, targets[i].target, targets[i].target, &targets[i].target_metrics);
+            writer->num_roots++;
+        }
+        trace_attach(NULL, 0);
+        return;
+    }
+
+    struct snap_plan* roots = haz_malloc(sizeof(struct snap_plan) * num_targets);
+    size_t queue_size = (size_t)num_targets + 16;
+    struct snap_plan** queue = haz_malloc(sizeof(struct snap_plan*) * queue_size);
+    size_t head = 0;
+    size_t tail = 0;
+    for (int i = 0; i < num_targets; i++)
+    {
+        roots[i].path = haz_strdup(targets[i].target);
+        roots[i].name = haz_strdup(targets[i].target);
+        metrics_zero(&roots[i].metrics);
+        roots[i].expanded = false;
+        roots[i].children = NULL;
+        roots[i].num_children = 0;
+        queue[tail++] = &roots[i];
+    }
+    while (head < tail && tail - head < (size_t)threadnum * SNAP_TASKS) // expand the shallowest subtree until there are enough
+    {
+        struct snap_plan* plan = queue[head++];
+        snap_expand(writer, plan);
+        if (tail + plan->num_children > queue_size)
+        {
+            queue_size = (tail + plan->num_children) * 2;
+            queue = haz_realloc(queue, sizeof(struct snap_plan*) * queue_size);
+        }
+        for (size_t i = 0; i < plan->num_children; i++)
+        {
+            queue[tail++] = &plan->children[i];
+        }
+    }
+
+    trace_attach(NULL, 0);
+
+    struct snap_pool pool;
+    pool.trace = trace;
+    pool.tasks = queue + head;
+    pool.num_tasks = tail - head;
+    pool.next = 0;
+    if (pthread_mutex_init(&pool.lock, NULL) != 0)
+    {
+        perror("failed to init mutex");
+        exit(EXIT_FAILURE);
+    }
+    pool.fragments = haz_malloc(sizeof(struct snap_writer) * threadnum);
+    pool.exit_codes = haz_malloc(sizeof(int) * threadnum);
+    pthread_t threads[threadnum];
+    struct snap_arg args[threadnum];
+    for (int i = 0; i < threadnum; i++)
+    {
+        pool.exit_codes[i] = 0;
+        snap_fragment_open(&pool.fragments[i], &pool.exit_codes[i]);
+        args[i].pool = &pool;
+        args[i].id = i;
+        if (pthread_create(&threads[i], NULL, &snap_worker, &args[i]) != 0)
+        {
+            perror("failed to create thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < threadnum; i++)
+    {
+        if (pthread_join(threads[i], NULL) != 0)
+        {
+            perror("failed to join thread");
+            exit(EXIT_FAILURE);
+        }
+        if (pool.exit_codes[i] != 0)
+        {
+            *writer->exit_code = pool.exit_codes[i];
+        }
+    }
+
+    for (int i = 0; i < num_targets; i++)
+    {
+        snap_merge(writer, &pool, &roots[i]);
+        writer->num_roots++;
+        metrics_add(&targets[i].target_metrics, &roots[i].metrics);
+        snap_free_plan(&roots[i]);
+    }
+    for (int i = 0; i < threadnum; i++)
+    {
+        snap_fragment_close(&pool.fragments[i]);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.fragments);
+    free(pool.exit_codes);
+    free(queue);
+    free(roots);
+}
+
+/**
+ * maps a snapshot into memory and checks that it is one, kills the program if it isn't
+ *
+ * @param map     the map to set up
+ * @param file     path of the snapshot file
+ * @return      void
+ */
+void snap_map_open(struct snap_map* map, const char* file)
+{
+    int fd;
+    struct stat info;
+    if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "failed to open snapshot %s: ", file);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+    map->length = (size_t)info.st_size;
+    if (map->length < sizeof(struct snap_header))
+    {
+        fprintf(stderr, "%s is not a snapshot\n", file);
+        exit(EXIT_FAILURE);
+    }
+    if ((map->base = mmap(NULL, map->length, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("failed to map snapshot");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    const struct snap_header* header = map->base;
+    if (memcmp(header->magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) != 0 || header->version != SNAP_VERSION
+        || header->node_size != sizeof(struct snap_node))
+    {
+        fprintf(stderr, "%s is not a version %d snapshot\n", file, SNAP_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    if (header->num_nodes > (map->length - sizeof(struct snap_header)) / sizeof(struct snap_node)
+        || header->strings_offset != sizeof(struct snap_header) + header->num_nodes * sizeof(struct snap_node)
+        || header->strings_size > map->length - header->strings_offset
+        || (header->strings_size > 0 && ((const char*)map->base)[header->strings_offset + header->strings_size - 1] != '\0'))
+    {
+        fprintf(stderr, "snapshot %s is truncated or corrupt\n", file);
+        exit(EXIT_FAILURE);
+    }
+    map->header = header;
+    map->nodes = (const struct snap_node*)((const char*)map->base + sizeof(struct snap_header));
+    map->strings = (const char*)map->base + header->strings_offset;
+    map->metric = METRIC_BLOCKS;
+}
+
+/**
+ * unmaps a snapshot
+ *
+ * @param map     the map to close
+ * @return      void
+ */
+void snap_map_close(struct snap_map* map)
+{
+    munmap(map->base, map->length);
+}
+
+/**
+ * gets the name of a node
+ *
+ * @param map     the snapshot
+ * @param index     index of the node
+ * @return      the name, or "?" if the offset is outside the string table
+ */
+const char* snap_name(const struct snap_map* map, uint64_t index)
+{
+    if (map->nodes[index].name >= map->header->strings_size)
+    {
+        return "?";
+    }
+    return map->strings + map->nodes[index].name;
+}
+
+/**
+ * gets the chosen metric of a node
+ *
+ * @param map     the snapshot
+ * @param index     index of the node
+ * @return      blocks, bytes or inodes of the subtree
+ */
+uint64_t snap_size(const struct snap_map* map, uint64_t index)
+{
+    if (map->metric == METRIC_BYTES)
+    {
+        return map->nodes[index].bytes;
+    }
+    if (map->metric == METRIC_INODES)
+    {
+        return map->nodes[index].inodes;
+    }
+    return map->nodes[index].blocks;
+}
+
+/**
+ * maps an option of query and diff to the metric it picks
+ *
+ * @param argnum     the option from getopt_long
+ * @return      the METRIC_, or 0 if it isn't one of them
+ */
+int snap_metric_opt(int argnum)
+{
+    if (argnum == 'b')
+    {
+        return METRIC_BYTES;
+    }
+    if (argnum == 'I')
+    {
+        return METRIC_INODES;
+    }
+    if (argnum == 'B')
+    {
+        return METRIC_BLOCKS;
+    }
+    return 0;
+}
+
+/**
+ * gets the end of the subtree of a node, kills the program if it isn't inside of its parent
+ *
+ * @param map     the snapshot
+ * @param index     index of the node
+ * @param limit     end of the parent, or the number of nodes for a root
+ * @return      index one past the subtree
+ */
+uint64_t snap_end(const struct snap_map* map, uint64_t index, uint64_t limit)
+{
+    uint64_t end = map->nodes[index].end;
+    if (end <= index || end > limit)
+    {
+        fprintf(stderr, "snapshot is corrupt at node %llu\n", (unsigned long long)index);
+        exit(EXIT_FAILURE);
+    }
+    return end;
+}
+
+/**
+ * finds the node of a path, the path has to start with one of the roots as they were given to mdu
+ *
+ * @param map     the snapshot
+ * @param path     the path to look for
+ * @return      index of the node, or SNAP_NONE if it isn't in the snapshot
+ */
+uint64_t snap_lookup(const struct snap_map* map, const char* path)
+{
+    size_t path_length = strlen(path);
+    while (path_length > 1 && path[path_length - 1] == '/')
+    {
+        path_length--;
+    }
+
+    uint64_t num_nodes = map->header->num_nodes;
+    uint64_t next;
+    for (uint64_t root = 0; root < num_nodes; root = next)
+    {
+        next = snap_end(map, root, num_nodes);
+        const char* name = snap_name(map, root);
+        size_t length = strlen(name);
+        while (length > 1 && name[length - 1] == '/')
+        {
+            length--;
+        }
+        if (length > path_length || strncmp(path, name, length) != 0)
+        {
+            continue;
+        }
+        if (length < path_length && path[length] != '/' && name[length - 1] != '/')
+        {
+            continue;
+        }
+
+        // go down one component at a time, children are sorted so the search can stop early
+        char* rest = haz_strdup((char*)path + length);
+        rest[path_length - length] = '\0';
+        char* save;
+        uint64_t index = root;
+        for (char* component = strtok_r(rest, "/", &save); component != NULL && index != SNAP_NONE; component = strtok_r(NULL, "/", &save))
+        {
+            uint64_t end = map->nodes[index].end;
+            uint64_t child = index + 1;
+            index = SNAP_NONE;
+            while (child < end)
+            {
+                uint64_t child_end = snap_end(map, child, end); // before index can become child and be gone down
+                int cmp = strcmp(snap_name(map, child), component);
+                if (cmp == 0)
+                {
+                    index = child;
+                }
+                if (cmp >= 0)
+                {
+                    break;
+                }
+                child = child_end;
+            }
+        }
+        free(rest);
+        if (index != SNAP_NONE)
+        {
+            return index;
+        }
+    }
+    return SNAP_NONE;
+}
+
+/**
+ * builds the path of a node by going down from its root, skipping the siblings that don't contain it
+ *
+ * @param map     the snapshot
+ * @param index     index of the node
+ * @return      the allocated path
+ */
+char* snap_path(const struct snap_map* map, uint64_t index)
+{
+    uint64_t num_nodes = map->header->num_nodes;
+    uint64_t node = 0;
+    while (snap_end(map, node, num_nodes) <= index)
+    {
+        node = map->nodes[node].end;
+    }
+    char* path = haz_strdup((char*)snap_name(map, node));
+    while (node != index)
+    {
+        uint64_t end = map->nodes[node].end;
+        node++;
+        while (snap_end(map, node, end) <= index)
+        {
+            node = map->nodes[node].end;
+        }
+        path = target_appendstr(path, snap_name(map, node));
+    }
+    return path;
+}
\ No newline at end of file
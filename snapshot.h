@@ -0,0 +1,141 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "target.h"
+#include "trace.h"
+
+#define SNAP_MAGIC "MDUSNAP"
+#define SNAP_VERSION 2
+#define SNAP_BUFFER 4096 // nodes kept in memory before they are written out
+#define SNAP_NAMES 262144 // slots in the name dedup table, names past 3/4 full are stored as is
+#define SNAP_NONE UINT64_MAX
+#define SNAP_TASKS 8 // subtrees to split the targets into per thread, so a big one doesn't leave the others idle
+
+// the file starts with this header, followed by the node array and then the string table
+// everything is stored in host byte order
+struct snap_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t num_nodes;
+    uint64_t num_roots;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+// one directory, nodes are stored in DFS order so the subtree of node i is [i, end)
+// children of a directory are sorted by name, roots are stored in the order they were given
+// the metrics are for the whole subtree
+struct snap_node{
+    uint64_t blocks; // 512 byte blocks
+    uint64_t bytes; // apparent size
+    uint64_t inodes;
+    uint64_t end;
+    uint64_t name; // offset of the NUL terminated name in the string table
+};
+
+// slot in the name dedup table
+struct snap_name{
+    uint64_t hash;
+    uint64_t offset;
+    char* name;
+};
+
+// structure that holds the state while streaming a snapshot to disk
+struct snap_writer{
+    int fd;
+    FILE* strings;
+    uint64_t strings_size;
+    struct snap_name* names;
+    size_t names_used;
+
+    struct snap_node* buffer;
+    uint64_t buffer_base;
+    size_t buffer_num;
+    uint64_t num_nodes;
+    uint64_t num_roots;
+
+    int* exit_code;
+};
+
+// a directory near the top of a target, either read by the main thread to split the target up (expanded)
+// or a subtree that one of the threads walked into its fragment, nodes [start, start + count) and names from strings_start
+struct snap_plan{
+    char* path;
+    char* name;
+    struct metrics metrics; // its own files while expanding, the whole subtree once it's walked
+    bool expanded;
+    struct snap_plan* children; // sorted by name
+    size_t num_children;
+
+    int thread;
+    uint64_t start;
+    uint64_t count;
+    uint64_t strings_start;
+};
+
+// the subtrees that are left and the fragment each thread writes them to
+struct snap_pool{
+    struct snap_plan** tasks;
+    size_t num_tasks;
+    size_t next;
+    pthread_mutex_t lock;
+    struct snap_writer* fragments;
+    int* exit_codes; // one per thread, merged once they're joined
+    struct trace* trace; // NULL when not tracing
+};
+
+// what a snapshot thread gets when it's created
+struct snap_arg{
+    struct snap_pool* pool;
+    int id;
+};
+
+// a snapshot mapped into memory
+struct snap_map{
+    void* base;
+    size_t length;
+    const struct snap_header* header;
+    const struct snap_node* nodes;
+    const char* strings;
+    int metric; // the METRIC_ that snap_size gives
+};
+
+void haz_pwrite(int fd, const void* buffer, size_t size, uint64_t offset);
+uint64_t snap_addname(struct snap_writer* writer, const char* name);
+uint64_t snap_push_node(struct snap_writer* writer, const char* name);
+void snap_flush_nodes(struct snap_writer* writer);
+void snap_close_node(struct snap_writer* writer, uint64_t index, const struct metrics* metrics);
+void snap_writer_open(struct snap_writer* writer, const char* file, int* exit_code);
+void snap_writer_close(struct snap_writer* writer);
+void snap_error(struct snap_writer* writer, const char* message, const char* path);
+int snap_compare(const void* a, const void* b);
+bool snap_list(struct snap_writer* writer, char* path, struct metrics* metrics, char*** dirs, size_t* num_dirs);
+void snap_walk(struct snap_writer* writer, char* path, const char* name, struct metrics* metrics);
+void snap_fragment_open(struct snap_writer* writer, int* exit_code);
+void snap_fragment_close(struct snap_writer* writer);
+void snap_expand(struct snap_writer* writer, struct snap_plan* plan);
+void* snap_worker(void* arg);
+void snap_copy(struct snap_writer* writer, struct snap_writer* fragment, const struct snap_plan* plan);
+void snap_merge(struct snap_writer* writer, struct snap_pool* pool, struct snap_plan* plan);
+void snap_free_plan(struct snap_plan* plan);
+void snap_targets(struct snap_writer* writer, struct target* targets, int num_targets, int threadnum, struct trace* trace);
+void snap_map_open(struct snap_map* map, const char* file);
+void snap_map_close(struct snap_map* map);
+const char* snap_name(const struct snap_map* map, uint64_t index);
+uint64_t snap_size(const struct snap_map* map, uint64_t index);
+int snap_metric_opt(int argnum);
+uint64_t snap_end(const struct snap_map* map, uint64_t index, uint64_t limit);
+uint64_t snap_lookup(const struct snap_map* map, const char* path);
+char* snap_path(const struct snap_map* map, uint64_t index);
\ No newline at end of file
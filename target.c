@@ -52,6 +52,45 @@ void *haz_realloc(void *source, size_t size)
     return temp;
 }
 
+/**
+ * makes room for one more element at the end of a list, doubling it when it's full
+ *
+ * @param list     the list, NULL while it's empty
+ * @param num     number of elements in the list, is incremented
+ * @param size     number of elements the list has room for
+ * @param element     size of an element
+ * @return      the list, which may have moved, the new element is the last one
+ */
+void *haz_append(void *list, size_t *num, size_t *size, size_t element)
+{
+    if (*num == *size)
+    {
+        *size = *size == 0 ? 16 : *size * 2;
+        list = haz_realloc(list, element * *size);
+    }
+    (*num)++;
+    return list;
+}
+
+/**
+ * FNV-1a hash of a key, for the hash tables of the snapshot and the watch
+ *
+ * @param key     the bytes to hash
+ * @param len     number of bytes
+ * @return      the hash
+ */
+uint64_t target_hash(const void *key, size_t len)
+{
+    const unsigned char *c = key;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= c[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 /**
  * concatenates two strings in a path life fashion
  *
@@ -83,22 +122,190 @@ void target_extend_pathlist(struct target *target)
 
 
 /**
- * adds a copy of the path to the target
+ * pushes an allocated path on the target, spills if it takes more memory than it may
  *
  * @param target     target to add to
- * @param path     the size to be allocated
+ * @param path     the path, which the target now owns
  * @return      void
  */
-void target_addpath(struct target *target, char *path)
+void target_push(struct target *target, char *path)
 {
     target->path_head++;
     if (target->path_head >= target->path_size)
     {
         target_extend_pathlist(target);
     }
-    char *tempPath = haz_strdup(path);
-    target->path_list[target->path_head] = tempPath;
+    target->path_list[target->path_head] = path;
     target->path_num++;
+    target->mem += strlen(path) + 1 + sizeof(char *);
+    if (target->max_mem > 0 && target->mem > target->max_mem && target->path_head > 0)
+    {
+        target_spill(target);
+    }
+}
+
+/**
+ * writes the oldest half of the paths in memory to the spill file as one batch
+ * paths are front coded, each one is stored as how much it shares with the one before, the length of the rest, and the rest
+ *
+ * @param target     target to spill
+ * @return      void
+ */
+void target_spill(struct target *target)
+{
+    if (target->spill_fd < 0)
+    {
+        const char *dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+        char *name = target_appendstr(haz_strdup((char *)dir), "mdu-spill-XXXXXX");
+        if ((target->spill_fd = mkstemp(name)) < 0)
+        {
+            fprintf(stderr, "failed to create spill file in %s: ", dir);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+        unlink(name); // gone once it's closed, or if mdu dies
+        free(name);
+    }
+
+    int count = (target->path_head + 1) / 2;
+    size_t length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        length += 2 * sizeof(uint32_t) + strlen(target->path_list[i]);
+    }
+    char *buffer = haz_malloc(length);
+    char *c = buffer;
+    const char *previous = "";
+    for (int i = 0; i < count; i++)
+    {
+        const char *path = target->path_list[i];
+        uint32_t shared = 0;
+        while (previous[shared] != '\0' && previous[shared] == path[shared])
+        {
+            shared++;
+        }
+        uint32_t rest = (uint32_t)strlen(path + shared);
+        memcpy(c, &shared, sizeof(uint32_t));
+        memcpy(c + sizeof(uint32_t), &rest, sizeof(uint32_t));
+        memcpy(c + 2 * sizeof(uint32_t), path + shared, rest);
+        c += 2 * sizeof(uint32_t) + rest;
+        previous = path;
+    }
+    length = (size_t)(c - buffer);
+
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t result = pwrite(target->spill_fd, buffer + written, length - written, (off_t)(target->spill_size + written));
+        if (result < 0)
+        {
+            perror("failed to write spill file");
+            exit(EXIT_FAILURE);
+        }
+        written += (size_t)result;
+    }
+    free(buffer);
+
+    if (target->num_batches == target->batches_size)
+    {
+        target->batches_size = target->batches_size == 0 ? 16 : target->batches_size * 2;
+        target->batches = haz_realloc(target->batches, sizeof(struct spill_batch) * target->batches_size);
+    }
+    struct spill_batch *batch = &target->batches[target->num_batches++];
+    batch->offset = target->spill_size;
+    batch->length = length;
+    batch->count = count;
+    target->spill_size += length;
+
+    for (int i = 0; i < count; i++)
+    {
+        target->mem -= strlen(target->path_list[i]) + 1 + sizeof(char *);
+        free(target->path_list[i]);
+    }
+    memmove(target->path_list, target->path_list + count, sizeof(char *) * (target->path_head + 1 - count));
+    target->path_head -= count;
+    target->path_spilled += count;
+}
+
+/**
+ * reads the last spilled batch back into memory, which has to be empty, and gives its space in the file back
+ *
+ * @param target     target to read into
+ * @return      void
+ */
+void target_unspill(struct target *target)
+{
+    struct spill_batch batch = target->batches[--target->num_batches];
+    char *buffer = haz_malloc(batch.length);
+    size_t read = 0;
+    while (read < batch.length)
+    {
+        ssize_t result = pread(target->spill_fd, buffer + read, batch.length - read, (off_t)(batch.offset + read));
+        if (result <= 0)
+        {
+            perror("failed to read spill file");
+            exit(EXIT_FAILURE);
+        }
+        read += (size_t)result;
+    }
+    if (ftruncate(target->spill_fd, (off_t)batch.offset) != 0)
+    {
+        perror("failed to truncate spill file");
+        exit(EXIT_FAILURE);
+    }
+    target->spill_size = batch.offset;
+
+    while (target->path_size < batch.count)
+    {
+        target_extend_pathlist(target);
+    }
+    const char *c = buffer;
+    const char *previous = "";
+    for (int i = 0; i < batch.count; i++)
+    {
+        uint32_t shared;
+        uint32_t rest;
+        memcpy(&shared, c, sizeof(uint32_t));
+        memcpy(&rest, c + sizeof(uint32_t), sizeof(uint32_t));
+        char *path = haz_malloc(shared + rest + 1);
+        memcpy(path, previous, shared);
+        memcpy(path + shared, c + 2 * sizeof(uint32_t), rest);
+        path[shared + rest] = '\0';
+        c += 2 * sizeof(uint32_t) + rest;
+        target->path_list[i] = path;
+        target->mem += shared + rest + 1 + sizeof(char *);
+        previous = path;
+    }
+    free(buffer);
+    target->path_head = batch.count - 1;
+    target->path_spilled -= batch.count;
+}
+
+/**
+ * closes the spill file of a target, if it has one
+ *
+ * @param target     the target
+ * @return      void
+ */
+void target_closespill(struct target *target)
+{
+    if (target->spill_fd >= 0)
+    {
+        close(target->spill_fd);
+    }
+    free(target->batches);
+}
+
+/**
+ * adds a copy of the path to the target
+ *
+ * @param target     target to add to
+ * @param path     the size to be allocated
+ * @return      void
+ */
+void target_addpath(struct target *target, char *path)
+{
+    target_push(target, haz_strdup(path));
 }
 
 
@@ -112,15 +319,9 @@ void target_addpath(struct target *target, char *path)
  */
 void target_addcatpath(struct target *target, char *path, const char *d_path)
 {
-    target->path_head++;
-    if (target->path_head >= target->path_size)
-    {
-        target_extend_pathlist(target);
-    }
     char *tempPath = haz_strdup(path);
     tempPath = target_appendstr(tempPath, d_path);
-    target->path_list[target->path_head] = tempPath;
-    target->path_num++;
+    target_push(target, tempPath);
 }
 
 /**
@@ -135,8 +336,12 @@ char *target_getpath(struct target *target)
     {
         return NULL;
     }
-    char *tempPath = haz_strdup(target->path_list[target->path_head]);
-    free(target->path_list[target->path_head]);
+    if (target->path_head < 0) // the rest is on disk
+    {
+        target_unspill(target);
+    }
+    char *tempPath = target->path_list[target->path_head];
+    target->mem -= strlen(tempPath) + 1 + sizeof(char *);
     target->path_num--;
     target->path_head--;
     return tempPath;
@@ -153,11 +358,20 @@ void target_setup(struct target *target, char *path)
 {
     target->path_size = STARTSIZE;
     target->path_list = haz_malloc((size_t)(sizeof(char *) * target->path_size));
-    target->path_head = 0;
-    target->path_num = 1;
+    target->path_head = -1;
+    target->path_num = 0;
+
+    metrics_zero(&target->target_metrics);
 
-    target->target_size = 0;
+    target->mem = 0;
+    target->max_mem = 0;
+    target->path_spilled = 0;
+    target->spill_fd = -1;
+    target->spill_size = 0;
+    target->batches = NULL;
+    target->num_batches = 0;
+    target->batches_size = 0;
 
-    target->path_list[target->path_head] = haz_strdup(path);
+    target_addpath(target, path);
     target->target = haz_strdup(path);
 }
\ No newline at end of file
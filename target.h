@@ -4,11 +4,22 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include "metrics.h"
 
 
 #define STARTSIZE 2;
 
+// a batch of paths that was spilled to disk, batches are read back last first
+struct spill_batch{
+    uint64_t offset;
+    uint64_t length;
+    int count;
+};
+
 // structure that holds information needed to go through a list of path
+// path_num counts the spilled paths too, path_head is the top of the ones in memory
 struct target{
     char** path_list;
     char* target;
@@ -16,14 +27,29 @@ struct target{
     int path_head;
     int path_size;
 
-    int target_size;
+    size_t mem; // bytes the paths in memory take
+    size_t max_mem; // spill the oldest half past this, 0 for no limit
+    int path_spilled;
+    int spill_fd;
+    uint64_t spill_size;
+    struct spill_batch* batches;
+    int num_batches;
+    int batches_size;
+
+    struct metrics target_metrics;
 };
 void target_extend_pathlist(struct target *target);
 void* haz_strdup(char* string);
 void* haz_malloc(size_t size);
 void* haz_realloc(void* source, size_t size);
+void* haz_append(void* list, size_t* num, size_t* size, size_t element);
+uint64_t target_hash(const void* key, size_t len);
 void target_setup(struct target* target, char* path);
 void target_addpath(struct target* target, char* path);
 void target_addcatpath(struct target* target, char* path, const char* d_path);
 char* target_getpath(struct target* target);
-char* target_appendstr(char* destination, const char* appendee);
\ No newline at end of file
+char* target_appendstr(char* destination, const char* appendee);
+void target_push(struct target* target, char* path);
+void target_spill(struct target* target);
+void target_unspill(struct target* target);
+void target_closespill(struct target* target);
\ No newline at end of file
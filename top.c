@@ -0,0 +1,101 @@
+#include "top.h"
+
+/**
+ * sets up an empty heap
+ *
+ * @param top     the heap
+ * @param max     how many entries it keeps, at least one
+ * @param size     size of an entry
+ * @param score     gives the score of an entry, the highest ones are kept
+ * @return      void
+ */
+void top_init(struct top* top, size_t max, size_t size, double (*score)(const void* entry))
+{
+    top->entries = haz_malloc(size * max);
+    top->num = 0;
+    top->max = max;
+    top->size = size;
+    top->score = score;
+    top->spare = haz_malloc(size);
+}
+
+/**
+ * frees the entries of a heap
+ *
+ * @param top     the heap
+ * @return      void
+ */
+void top_free(struct top* top)
+{
+    free(top->entries);
+    free(top->spare);
+}
+
+/**
+ * gets an entry
+ *
+ * @param top     the heap
+ * @param i     index of the entry
+ * @return      pointer to the entry
+ */
+void* top_entry(struct top* top, size_t i)
+{
+    return top->entries + i * top->size;
+}
+
+/**
+ * pushes an entry, once the heap is full it only goes in if it scores higher than the lowest one, which it replaces
+ *
+ * @param top     the heap
+ * @param entry     the entry to copy in
+ * @return      void
+ */
+void top_push(struct top* top, const void* entry)
+{
+    double score = top->score(entry);
+    size_t i;
+    if (top->num < top->max) // sift up
+    {
+        i = top->num++;
+        while (i > 0 && top->score(top_entry(top, (i - 1) / 2)) > score)
+        {
+            memcpy(top_entry(top, i), top_entry(top, (i - 1) / 2), top->size);
+            i = (i - 1) / 2;
+        }
+        memcpy(top_entry(top, i), entry, top->size);
+        return;
+    }
+    if (score <= top->score(top_entry(top, 0)))
+    {
+        return;
+    }
+    memcpy(top->spare, entry, top->size); // entry may not stay valid while the heap moves
+    i = 0; // replace the smallest and sift down
+    while (2 * i + 1 < top->num)
+    {
+        size_t child = 2 * i + 1;
+        if (child + 1 < top->num && top->score(top_entry(top, child + 1)) < top->score(top_entry(top, child)))
+        {
+            child++;
+        }
+        if (top->score(top_entry(top, child)) >= score)
+        {
+            break;
+        }
+        memcpy(top_entry(top, i), top_entry(top, child), top->size);
+        i = child;
+    }
+    memcpy(top_entry(top, i), top->spare, top->size);
+}
+
+/**
+ * sorts the entries for printing, after this it's no longer a heap
+ *
+ * @param top     the heap
+ * @param compare     qsort compare of two entries
+ * @return      void
+ */
+void top_sort(struct top* top, int (*compare)(const void* a, const void* b))
+{
+    qsort(top->entries, top->num, top->size, compare);
+}
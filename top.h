@@ -0,0 +1,22 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "target.h"
+
+// keeps the max entries with the highest score that were pushed, as a min heap on the score
+// entries are copied in, size is the size of one entry and score gives its key
+struct top{
+    char* entries;
+    size_t num;
+    size_t max;
+    size_t size;
+    double (*score)(const void* entry);
+    char* spare; // room for the entry that's being moved
+};
+
+void top_init(struct top* top, size_t max, size_t size, double (*score)(const void* entry));
+void top_free(struct top* top);
+void* top_entry(struct top* top, size_t i);
+void top_push(struct top* top, const void* entry);
+void top_sort(struct top* top, int (*compare)(const void* a, const void* b));
@@ -0,0 +1,107 @@
+#include "trace.h"
+
+_Thread_local struct trace_buffer* trace_local = NULL;
+
+/**
+ * gets the time for the trace
+ *
+ * @return      monotonic time in nanoseconds
+ */
+uint64_t trace_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * sets up a ring for every thread
+ *
+ * @param trace     the trace to set up
+ * @param file     where the trace is written at exit
+ * @param num_threads     number of threads
+ * @return      void
+ */
+void trace_init(struct trace* trace, char* file, int num_threads)
+{
+    trace->file = file;
+    trace->num_buffers = num_threads;
+    trace->buffers = haz_malloc(sizeof(struct trace_buffer) * num_threads);
+    for (int i = 0; i < num_threads; i++)
+    {
+        trace->buffers[i].events = haz_malloc(sizeof(struct trace_event) * TRACE_EVENTS);
+        trace->buffers[i].head = 0;
+    }
+    trace->start = trace_clock();
+}
+
+/**
+ * makes the calling thread record into its ring, does nothing if there is no trace
+ *
+ * @param trace     the trace, or NULL
+ * @param id     index of the thread
+ * @return      void
+ */
+void trace_attach(struct trace* trace, int id)
+{
+    trace_local = trace != NULL ? &trace->buffers[id] : NULL;
+}
+
+/**
+ * writes all the rings as Chrome trace-event JSON, which Perfetto and chrome://tracing can load
+ *
+ * @param trace     the trace to write
+ * @return      void
+ */
+void trace_write(struct trace* trace)
+{
+    static const char* names[] = {"readdir", "lstat", "checkothers", "wait", "get", "status"};
+    FILE* file = fopen(trace->file, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "failed to open trace %s: ", trace->file);
+        perror("");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"mdu\"}}");
+    for (int i = 0; i < trace->num_buffers; i++)
+    {
+        struct trace_buffer* buffer = &trace->buffers[i];
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", i, i);
+        uint64_t first = 0;
+        if (buffer->head > TRACE_EVENTS)
+        {
+            first = buffer->head - TRACE_EVENTS;
+            fprintf(stderr, "trace of worker %d wrapped, its first %" PRIu64 " events are lost\n", i, first);
+        }
+        for (uint64_t j = first; j < buffer->head; j++)
+        {
+            struct trace_event* event = &buffer->events[j & (TRACE_EVENTS - 1)];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"mdu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    names[event->kind], i, (double)(event->start - trace->start) / 1000.0, (double)(event->end - event->start) / 1000.0);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0)
+    {
+        perror("failed to write trace");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * frees the rings
+ *
+ * @param trace     the trace to free
+ * @return      void
+ */
+void trace_destroy(struct trace* trace)
+{
+    for (int i = 0; i < trace->num_buffers; i++)
+    {
+        free(trace->buffers[i].events);
+    }
+    free(trace->buffers);
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include "target.h"
+
+#define TRACE_EVENTS 262144 // events kept per thread, has to be a power of two, older ones are overwritten
+
+// what a thread was doing
+enum trace_kind{
+    TRACE_READDIR,
+    TRACE_STAT,
+    TRACE_CHECKOTHERS,
+    TRACE_WAIT,
+    TRACE_GET,
+    TRACE_STATUS
+};
+
+// one complete event, written as an "X" event so a pair can't be split by the ring wrapping
+struct trace_event{
+    uint64_t start;
+    uint64_t end;
+    enum trace_kind kind;
+};
+
+// the ring of one thread, only that thread writes it and it's only read after the threads are joined
+struct trace_buffer{
+    struct trace_event* events;
+    uint64_t head;
+};
+
+// structure that holds the buffers of all the threads
+struct trace{
+    struct trace_buffer* buffers;
+    int num_buffers;
+    uint64_t start;
+    char* file;
+};
+
+extern _Thread_local struct trace_buffer* trace_local;
+
+uint64_t trace_clock(void);
+void trace_init(struct trace* trace, char* file, int num_threads);
+void trace_attach(struct trace* trace, int id);
+void trace_write(struct trace* trace);
+void trace_destroy(struct trace* trace);
+
+/**
+ * starts timing something, when tracing is off this is just the branch
+ *
+ * @return      the time, or 0 when tracing is off
+ */
+static inline uint64_t trace_begin(void)
+{
+    if (trace_local == NULL)
+    {
+        return 0;
+    }
+    return trace_clock();
+}
+
+/**
+ * records something that was timed with trace_begin into the thread's ring
+ *
+ * @param kind     what the thread was doing
+ * @param start     what trace_begin returned
+ * @return      void
+ */
+static inline void trace_end(enum trace_kind kind, uint64_t start)
+{
+    if (trace_local == NULL)
+    {
+        return;
+    }
+    struct trace_event* event = &trace_local->events[trace_local->head & (TRACE_EVENTS - 1)];
+    event->start = start;
+    event->end = trace_clock();
+    event->kind = kind;
+    trace_local->head++;
+}
\ No newline at end of file
@@ -0,0 +1,474 @@
+#include "visit.h"
+
+/**
+ * hashes a device and inode, the low bits pick the bucket and the high bits the shard
+ *
+ * @param dev     the device
+ * @param ino     the inode
+ * @return      the hash
+ */
+uint64_t visit_hash(dev_t dev, ino_t ino)
+{
+    uint64_t hash = (uint64_t)ino ^ ((uint64_t)dev * 0x9e3779b97f4a7c15ULL); // splitmix64 finalizer
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+/**
+ * sets up an empty set
+ *
+ * @param set     the set
+ * @param totals     true if a later target can reach what an earlier one read, so totals have to be kept
+ * @param show     METRIC_ flags of what is printed, only those fields are kept in the totals
+ * @return      void
+ */
+void visit_init(struct visit_set* set, bool totals, int show)
+{
+    if (pthread_mutex_init(&set->reuse_lock, NULL) != 0)
+    {
+        perror("failed to init mutex");
+        exit(EXIT_FAILURE);
+    }
+    set->totals = totals;
+    set->show = show;
+    set->fields = ((show & METRIC_BLOCKS) != 0) + ((show & METRIC_BYTES) != 0) + ((show & METRIC_INODES) != 0) + ((show & METRIC_TYPES) != 0) * 4;
+    set->reused = NULL;
+    set->num_reused = 0;
+    set->reused_size = 0;
+    set->stolen = NULL;
+    set->num_stolen = 0;
+    set->stolen_size = 0;
+    if ((set->shards = aligned_alloc(_Alignof(struct visit_shard), sizeof(struct visit_shard) * VISIT_SHARDS)) == NULL)
+    {
+        perror("failed to allocate visited set");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < VISIT_SHARDS; i++)
+    {
+        struct visit_shard* shard = &set->shards[i];
+        if (pthread_mutex_init(&shard->lock, NULL) != 0)
+        {
+            perror("failed to init mutex");
+            exit(EXIT_FAILURE);
+        }
+        shard->size = VISIT_BUCKETS;
+        shard->used = 0;
+        shard->buckets = haz_malloc(sizeof(struct visit_key*) * shard->size);
+        memset(shard->buckets, 0, sizeof(struct visit_key*) * shard->size);
+        shard->claimed = NULL;
+        shard->num_claimed = 0;
+        shard->claimed_size = 0;
+    }
+}
+
+/**
+ * frees the set and every directory in it
+ *
+ * @param set     the set
+ * @return      void
+ */
+void visit_destroy(struct visit_set* set)
+{
+    for (int i = 0; i < VISIT_SHARDS; i++)
+    {
+        struct visit_shard* shard = &set->shards[i];
+        for (size_t j = 0; j < shard->size; j++)
+        {
+            struct visit_key* key = shard->buckets[j];
+            while (key != NULL)
+            {
+                struct visit_key* next = key->next;
+                free(key);
+                key = next;
+            }
+        }
+        free(shard->buckets);
+        free(shard->claimed);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(set->shards);
+    free(set->reused);
+    free(set->stolen);
+    pthread_mutex_destroy(&set->reuse_lock);
+}
+
+/**
+ * adds the printed fields of some metrics to a total, in the order they're printed
+ *
+ * @param set     the set
+ * @param total     the total of a directory
+ * @param metrics     what to add
+ * @return      void
+ */
+void visit_store(const struct visit_set* set, int64_t* total, const struct metrics* metrics)
+{
+    if (set->show & METRIC_BLOCKS)
+    {
+        *total++ += metrics->blocks;
+    }
+    if (set->show & METRIC_BYTES)
+    {
+        *total++ += metrics->bytes;
+    }
+    if (set->show & METRIC_INODES)
+    {
+        *total++ += metrics->inodes;
+    }
+    if (set->show & METRIC_TYPES)
+    {
+        *total++ += metrics->files;
+        *total++ += metrics->dirs;
+        *total++ += metrics->links;
+        *total += metrics->others;
+    }
+}
+
+/**
+ * adds a total to some metrics, the fields that aren't printed are left as they are
+ *
+ * @param set     the set
+ * @param total     the total of a directory
+ * @param metrics     where to add it
+ * @return      void
+ */
+void visit_load(const struct visit_set* set, const int64_t* total, struct metrics* metrics)
+{
+    if (set->show & METRIC_BLOCKS)
+    {
+        metrics->blocks += *total++;
+    }
+    if (set->show & METRIC_BYTES)
+    {
+        metrics->bytes += *total++;
+    }
+    if (set->show & METRIC_INODES)
+    {
+        metrics->inodes += *total++;
+    }
+    if (set->show & METRIC_TYPES)
+    {
+        metrics->files += *total++;
+        metrics->dirs += *total++;
+        metrics->links += *total++;
+        metrics->others += *total;
+    }
+}
+
+/**
+ * doubles the buckets of a shard, the shard has to be locked
+ *
+ * @param shard     the shard
+ * @return      void
+ */
+void visit_grow(struct visit_shard* shard)
+{
+    size_t size = shard->size * 2;
+    struct visit_key** buckets = haz_malloc(sizeof(struct visit_key*) * size);
+    memset(buckets, 0, sizeof(struct visit_key*) * size);
+    for (size_t i = 0; i < shard->size; i++)
+    {
+        struct visit_key* key = shard->buckets[i];
+        while (key != NULL)
+        {
+            struct visit_key* next = key->next;
+            size_t bucket = visit_hash(key->dev, key->ino) & (size - 1);
+            key->next = buckets[bucket];
+            buckets[bucket] = key;
+            key = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->size = size;
+}
+
+/**
+ * claims a directory for reading, only one caller gets true for the same directory
+ *
+ * @param set     the set
+ * @param file     stat of the directory
+ * @param parent     the directory it was found in, NULL for a target or when there are no totals
+ * @param root     index of the target being read
+ * @param found     set to the directory that was already there if it returns false, NULL when there are no totals
+ * @return      true if the directory is new and should be read
+ */
+bool visit_claim(struct visit_set* set, const struct stat* file, struct visit_dir* parent, int root, struct visit_dir** found)
+{
+    uint64_t hash = visit_hash(file->st_dev, file->st_ino);
+    struct visit_shard* shard = &set->shards[hash >> 56 & (VISIT_SHARDS - 1)];
+    pthread_mutex_lock(&shard->lock);
+    size_t bucket = hash & (shard->size - 1);
+    for (struct visit_key* key = shard->buckets[bucket]; key != NULL; key = key->next)
+    {
+        if (key->ino == file->st_ino && key->dev == file->st_dev)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            *found = set->totals ? (struct visit_dir*)key : NULL;
+            return false;
+        }
+    }
+
+    struct visit_key* key;
+    if (set->totals)
+    {
+        struct visit_dir* dir = haz_malloc(sizeof(struct visit_dir) + sizeof(int64_t) * set->fields);
+        dir->root = root;
+        dir->reused_by = -1;
+        dir->depth = parent != NULL ? parent->depth + 1 : 0;
+        dir->parent = parent;
+        dir->partial = false;
+        memset(dir->total, 0, sizeof(int64_t) * set->fields);
+        shard->claimed = haz_append(shard->claimed, &shard->num_claimed, &shard->claimed_size, sizeof(struct visit_dir*));
+        shard->claimed[shard->num_claimed - 1] = dir;
+        key = &dir->key;
+    }
+    else
+    {
+        key = haz_malloc(sizeof(struct visit_key));
+    }
+    key->dev = file->st_dev;
+    key->ino = file->st_ino;
+    key->next = shard->buckets[bucket];
+    shard->buckets[bucket] = key;
+    if (++shard->used > shard->size)
+    {
+        visit_grow(shard);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return true;
+}
+
+/**
+ * looks up a directory, only when there are totals
+ *
+ * @param set     the set
+ * @param file     stat of the directory
+ * @return      the directory, or NULL if it was never claimed
+ */
+struct visit_dir* visit_find(struct visit_set* set, const struct stat* file)
+{
+    uint64_t hash = visit_hash(file->st_dev, file->st_ino);
+    struct visit_shard* shard = &set->shards[hash >> 56 & (VISIT_SHARDS - 1)];
+    pthread_mutex_lock(&shard->lock);
+    struct visit_key* key = shard->buckets[hash & (shard->size - 1)];
+    while (key != NULL && (key->ino != file->st_ino || key->dev != file->st_dev))
+    {
+        key = key->next;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return (struct visit_dir*)key;
+}
+
+/**
+ * checks if a directory is below another by parent, which for a total that isn't partial is all that's in it
+ * the reuse lock has to be held
+ *
+ * @param dir     the directory
+ * @param ancestor     the directory that may be above it, or NULL to look for one the target took the total of
+ * @param root     index of the target being read, used when ancestor is NULL
+ * @return      true if it's the ancestor or below it
+ */
+bool visit_inside(const struct visit_dir* dir, const struct visit_dir* ancestor, int root)
+{
+    for (; dir != NULL; dir = dir->parent)
+    {
+        if (ancestor != NULL ? dir == ancestor : dir->reused_by == root)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * marks a directory and everything above it as partial, the reuse lock has to be held
+ *
+ * @param dir     the directory, may be NULL
+ * @return      void
+ */
+void visit_spoil(struct visit_dir* dir)
+{
+    for (; dir != NULL; dir = dir->parent)
+    {
+        dir->partial = true;
+    }
+}
+
+/**
+ * a directory of the current target was found again, so the directories above where it was found are missing it,
+ * up to the first one that has it below itself, the reuse lock has to be held
+ *
+ * @param dir     the directory that was found again
+ * @param under     the directory it was found in, NULL for a target
+ * @return      void
+ */
+void visit_skip(struct visit_dir* dir, struct visit_dir* under)
+{
+    struct visit_dir* ancestor = dir;
+    for (; under != NULL; under = under->parent)
+    {
+        while (ancestor != NULL && ancestor->depth > under->depth)
+        {
+            ancestor = ancestor->parent;
+        }
+        if (ancestor == under)
+        {
+            return;
+        }
+        under->partial = true;
+    }
+}
+
+/**
+ * takes a directory of an earlier target over so the current one reads it again,
+ * everything its old total went into is marked partial, the reuse lock has to be held
+ *
+ * @param set     the set
+ * @param dir     the directory
+ * @param under     the directory it was found in, NULL for a target
+ * @param root     index of the target being read
+ * @return      void
+ */
+void visit_steal(struct visit_set* set, struct visit_dir* dir, struct visit_dir* under, int root)
+{
+    visit_spoil(dir);
+    dir->root = root;
+    dir->reused_by = -1;
+    dir->depth = under != NULL ? under->depth + 1 : 0;
+    dir->parent = under;
+    dir->partial = false;
+    memset(dir->total, 0, sizeof(int64_t) * set->fields);
+    set->stolen = haz_append(set->stolen, &set->num_stolen, &set->stolen_size, sizeof(struct visit_dir*));
+    set->stolen[set->num_stolen - 1] = dir;
+}
+
+/**
+ * handles a directory that was already claimed when it was found again
+ * under the same target nothing is counted, an earlier target's total is added without counting anything twice,
+ * if it's below one that was already taken nothing is added, if it's above some only the rest of it is added,
+ * and if its total is partial it's taken over and has to be read again
+ * a total that is taken can overlap others in ways parents don't show, so everything above under is partial after
+ *
+ * @param set     the set
+ * @param dir     the directory, NULL when there are no totals
+ * @param under     the directory it was found in, NULL for a target
+ * @param root     index of the target being read
+ * @param metrics     where to add the total
+ * @return      true if the directory has to be read
+ */
+bool visit_reuse(struct visit_set* set, struct visit_dir* dir, struct visit_dir* under, int root, struct metrics* metrics)
+{
+    if (dir == NULL) // one target, so it's a loop or a second path to it
+    {
+        return false;
+    }
+    pthread_mutex_lock(&set->reuse_lock);
+    if (dir->root == root) // a loop or a second path to it under this target counts it once
+    {
+        visit_skip(dir, under);
+        pthread_mutex_unlock(&set->reuse_lock);
+        return false;
+    }
+    if (visit_inside(dir, NULL, root)) // counted with one this target took
+    {
+        visit_spoil(under);
+    }
+    else if (dir->partial)
+    {
+        visit_steal(set, dir, under, root);
+        pthread_mutex_unlock(&set->reuse_lock);
+        return true;
+    }
+    else
+    {
+        struct metrics rest;
+        metrics_zero(&rest);
+        visit_load(set, dir->total, &rest);
+        for (size_t i = 0; i < set->num_reused;)
+        {
+            if (visit_inside(set->reused[i], dir, root)) // already counted, and now it's covered by this one
+            {
+                struct metrics taken;
+                metrics_zero(&taken);
+                visit_load(set, set->reused[i]->total, &taken);
+                metrics_sub(&rest, &taken);
+                set->reused[i] = set->reused[--set->num_reused];
+            }
+            else
+            {
+                i++;
+            }
+        }
+        set->reused = haz_append(set->reused, &set->num_reused, &set->reused_size, sizeof(struct visit_dir*));
+        set->reused[set->num_reused - 1] = dir;
+        dir->reused_by = root;
+        metrics_add(metrics, &rest);
+        visit_spoil(under);
+    }
+    pthread_mutex_unlock(&set->reuse_lock);
+    return false;
+}
+
+/**
+ * compares two directories for qsort, deepest first
+ *
+ * @param a     pointer to the first directory pointer
+ * @param b     pointer to the second directory pointer
+ * @return      <0, 0 or >0
+ */
+int visit_compare(const void* a, const void* b)
+{
+    const struct visit_dir* first = *(struct visit_dir* const*)a;
+    const struct visit_dir* second = *(struct visit_dir* const*)b;
+    return second->depth - first->depth;
+}
+
+/**
+ * adds the total of every directory the target claimed or took over into its parent, so a later target that reaches
+ * one of them can take its total instead of reading it again, only the directories of this target are looked at
+ * must only be called when no thread is reading
+ *
+ * @param set     the set
+ * @return      void
+ */
+void visit_finish(struct visit_set* set)
+{
+    set->num_reused = 0; // the next target starts over
+    size_t num = set->num_stolen;
+    for (int i = 0; i < VISIT_SHARDS; i++)
+    {
+        num += set->shards[i].num_claimed;
+    }
+    struct visit_dir** dirs = haz_malloc(sizeof(struct visit_dir*) * (num + 1));
+    num = 0;
+    for (size_t i = 0; i < set->num_stolen; i++)
+    {
+        dirs[num++] = set->stolen[i];
+    }
+    set->num_stolen = 0;
+    for (int i = 0; i < VISIT_SHARDS; i++)
+    {
+        struct visit_shard* shard = &set->shards[i];
+        for (size_t j = 0; j < shard->num_claimed; j++)
+        {
+            dirs[num++] = shard->claimed[j];
+        }
+        shard->num_claimed = 0;
+    }
+    qsort(dirs, num, sizeof(struct visit_dir*), visit_compare);
+    for (size_t i = 0; i < num; i++)
+    {
+        if (dirs[i]->parent != NULL)
+        {
+            for (int j = 0; j < set->fields; j++)
+            {
+                dirs[i]->parent->total[j] += dirs[i]->total[j];
+            }
+        }
+    }
+    free(dirs);
+}
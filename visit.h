@@ -0,0 +1,75 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "target.h"
+
+#define VISIT_SHARDS 256 // has to be a power of two, a directory only locks the shard its key hashes to
+#define VISIT_BUCKETS 64 // starting buckets per shard, has to be a power of two
+
+// a directory that has been claimed, with one target this is all that's kept of it
+struct visit_key{
+    struct visit_key* next; // next in the bucket
+    dev_t dev;
+    ino_t ino;
+};
+
+// a directory that has been claimed when there are more targets, total is filled in by the thread that reads it
+// and rolled up when its root is done, it only has the fields that are printed (see visit_store)
+struct visit_dir{
+    struct visit_key key; // first, so the buckets hold either
+    struct visit_dir* parent;
+    int root; // index of the target that claimed it
+    int reused_by; // last target that took its total
+    int depth;
+    bool partial; // total isn't exactly what is below it by parent, so a later target reads it again instead of taking it
+    int64_t total[];
+};
+
+// one part of the set, aligned so two shards' locks never share a cache line
+// claimed holds the directories the current target claimed in this shard, so a finished target doesn't look at the others
+struct visit_shard{
+    _Alignas(64) pthread_mutex_t lock;
+    struct visit_key** buckets;
+    size_t size;
+    size_t used;
+    struct visit_dir** claimed;
+    size_t num_claimed;
+    size_t claimed_size;
+};
+
+// set of the directories that have been read, keyed on device and inode
+// reused holds the directories of earlier targets the current one took the total of, stolen the ones it reads again,
+// they only change where targets overlap
+struct visit_set{
+    struct visit_shard* shards;
+    bool totals; // false with one target, then only the keys are kept
+    int show; // METRIC_ flags of the fields in the totals
+    int fields;
+    pthread_mutex_t reuse_lock;
+    struct visit_dir** reused;
+    size_t num_reused;
+    size_t reused_size;
+    struct visit_dir** stolen;
+    size_t num_stolen;
+    size_t stolen_size;
+};
+
+uint64_t visit_hash(dev_t dev, ino_t ino);
+void visit_init(struct visit_set* set, bool totals, int show);
+void visit_destroy(struct visit_set* set);
+void visit_store(const struct visit_set* set, int64_t* total, const struct metrics* metrics);
+void visit_load(const struct visit_set* set, const int64_t* total, struct metrics* metrics);
+void visit_grow(struct visit_shard* shard);
+bool visit_claim(struct visit_set* set, const struct stat* file, struct visit_dir* parent, int root, struct visit_dir** found);
+struct visit_dir* visit_find(struct visit_set* set, const struct stat* file);
+bool visit_inside(const struct visit_dir* dir, const struct visit_dir* ancestor, int root);
+void visit_spoil(struct visit_dir* dir);
+void visit_skip(struct visit_dir* dir, struct visit_dir* under);
+void visit_steal(struct visit_set* set, struct visit_dir* dir, struct visit_dir* under, int root);
+bool visit_reuse(struct visit_set* set, struct visit_dir* dir, struct visit_dir* under, int root, struct metrics* metrics);
+int visit_compare(const void* a, const void* b);
+void visit_finish(struct visit_set* set);
@@ -0,0 +1,959 @@
+#define _GNU_SOURCE // name_to_handle_at
+#include "watch.h"
+
+#define WATCH_TOMB ((struct watch_dir*)(uintptr_t)1)
+#define WATCH_ENTRY_TOMB ((char*)(uintptr_t)1)
+#define WATCH_IDSIZE (sizeof(fsid_t) + sizeof(int) + MAX_HANDLE_SZ)
+
+volatile sig_atomic_t watch_stopped = 0;
+
+/**
+ * sets up an empty table
+ *
+ * @param table     the table to set up
+ * @param by_id     true if the table is keyed on the id, false for the path
+ * @return      void
+ */
+void watch_table_init(struct watch_table* table, bool by_id)
+{
+    table->size = WATCH_TABLESIZE;
+    table->used = 0;
+    table->by_id = by_id;
+    if ((table->slots = calloc(table->size, sizeof(struct watch_slot))) == NULL)
+    {
+        fprintf(stderr, "failed to allocate space");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * finds the directory with the given key
+ *
+ * @param table     the table to look in
+ * @param key     the path or id
+ * @param len     length of the key
+ * @return      the directory, or NULL if it isn't in the table
+ */
+struct watch_dir* watch_table_find(struct watch_table* table, const void* key, size_t len)
+{
+    uint64_t hash = target_hash(key, len);
+    for (size_t i = hash & (table->size - 1); table->slots[i].dir != NULL; i = (i + 1) & (table->size - 1))
+    {
+        struct watch_dir* dir = table->slots[i].dir;
+        if (dir == WATCH_TOMB || table->slots[i].hash != hash)
+        {
+            continue;
+        }
+        if (table->by_id ? (dir->id_len == len && memcmp(dir->id, key, len) == 0) : strcmp(dir->path, key) == 0)
+        {
+            return dir;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * inserts a directory, doubles the table when it's 3/4 full counting removed slots
+ *
+ * @param table     the table to insert into
+ * @param dir     the directory to insert
+ * @return      void
+ */
+void watch_table_insert(struct watch_table* table, struct watch_dir* dir)
+{
+    if ((table->used + 1) * 4 > table->size * 3)
+    {
+        struct watch_table old = *table;
+        table->size += table->size;
+        table->used = 0;
+        if ((table->slots = calloc(table->size, sizeof(struct watch_slot))) == NULL)
+        {
+            fprintf(stderr, "failed to allocate space");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < old.size; i++)
+        {
+            if (old.slots[i].dir != NULL && old.slots[i].dir != WATCH_TOMB)
+            {
+                watch_table_insert(table, old.slots[i].dir);
+            }
+        }
+        free(old.slots);
+    }
+    uint64_t hash = table->by_id ? target_hash(dir->id, dir->id_len) : target_hash(dir->path, strlen(dir->path));
+    size_t i = hash & (table->size - 1);
+    while (table->slots[i].dir != NULL)
+    {
+        i = (i + 1) & (table->size - 1);
+    }
+    table->slots[i].hash = hash;
+    table->slots[i].dir = dir;
+    table->used++;
+}
+
+/**
+ * removes a directory, its slot is left as a tombstone until the table grows
+ *
+ * @param table     the table to remove from
+ * @param dir     the directory to remove
+ * @return      void
+ */
+void watch_table_remove(struct watch_table* table, struct watch_dir* dir)
+{
+    uint64_t hash = table->by_id ? target_hash(dir->id, dir->id_len) : target_hash(dir->path, strlen(dir->path));
+    for (size_t i = hash & (table->size - 1); table->slots[i].dir != NULL; i = (i + 1) & (table->size - 1))
+    {
+        if (table->slots[i].dir == dir)
+        {
+            table->slots[i].dir = WATCH_TOMB;
+            return;
+        }
+    }
+}
+
+/**
+ * sets up the watch, uses fanotify if the kernel lets us and inotify otherwise
+ *
+ * @param watch     the watch to set up
+ * @param interval     seconds between printing the totals
+ * @param exit_code     exit code of the program
+ * @return      void
+ */
+void watch_init(struct watch* watch, int interval, int* exit_code)
+{
+    watch->fanotify = true;
+    if ((watch->fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC, O_RDONLY)) < 0)
+    {
+        watch->fanotify = false;
+        if ((watch->fd = inotify_init1(IN_CLOEXEC)) < 0)
+        {
+            perror("failed to init inotify");
+            exit(EXIT_FAILURE);
+        }
+    }
+    watch->full = false;
+    watch->overflow = false;
+    watch->interval = interval;
+    if (pthread_mutex_init(&watch->lock, NULL) != 0)
+    {
+        perror("failed to init mutex");
+        exit(EXIT_FAILURE);
+    }
+    watch_table_init(&watch->paths, false);
+    watch_table_init(&watch->ids, true);
+    watch->unlinked = NULL;
+    watch->num_unlinked = 0;
+    watch->unlinked_size = 0;
+    watch->dirty = NULL;
+    watch->num_dirty = 0;
+    watch->dirty_size = 0;
+    watch->created = NULL;
+    watch->num_created = 0;
+    watch->created_size = 0;
+    watch->exit_code = exit_code;
+}
+
+/**
+ * frees every directory and closes the watch
+ *
+ * @param watch     the watch to destroy
+ * @return      void
+ */
+void watch_destroy(struct watch* watch)
+{
+    for (size_t i = 0; i < watch->paths.size; i++)
+    {
+        struct watch_dir* dir = watch->paths.slots[i].dir;
+        if (dir != NULL && dir != WATCH_TOMB)
+        {
+            watch_entries_free(&dir->entries);
+            free(dir->pending);
+            free(dir->path);
+            free(dir->id);
+            free(dir);
+        }
+    }
+    for (size_t i = 0; i < watch->num_created; i++)
+    {
+        free(watch->created[i]);
+    }
+    free(watch->paths.slots);
+    free(watch->ids.slots);
+    free(watch->unlinked);
+    free(watch->dirty);
+    free(watch->created);
+    pthread_mutex_destroy(&watch->lock);
+    close(watch->fd);
+}
+
+/**
+ * prints a warning about a path and marks the exit code
+ *
+ * @param watch     the watch
+ * @param message     what went wrong
+ * @param path     the path it went wrong at
+ * @return      void
+ */
+void watch_warn(struct watch* watch, const char* message, const char* path)
+{
+    pthread_mutex_lock(&watch->lock);
+    fprintf(stderr, "%s %s: ", message, path);
+    perror("");
+    *watch->exit_code = 1;
+    pthread_mutex_unlock(&watch->lock);
+}
+
+/**
+ * starts watching a directory, called by the threads before the directory is read so that nothing is missed
+ *
+ * @param watch     the watch
+ * @param path     path to the directory
+ * @param root     true for a target, which is followed if it's a link like opendir follows it, nothing below it is
+ * @return      the new directory, handed to watch_record once its size is known
+ */
+struct watch_dir* watch_begin(struct watch* watch, char* path, bool root)
+{
+    struct watch_dir* dir = haz_malloc(sizeof(struct watch_dir));
+    dir->path = haz_strdup(path);
+    dir->id = NULL;
+    dir->id_len = 0;
+    dir->wd = -1;
+    metrics_zero(&dir->own);
+    metrics_zero(&dir->total);
+    metrics_zero(&dir->self);
+    dir->dirty = false;
+    dir->reread = false;
+    dir->entries.slots = NULL;
+    dir->entries.size = 0;
+    dir->entries.used = 0;
+    dir->entries.live = 0;
+    dir->pending = NULL;
+    dir->num_pending = 0;
+    dir->pending_size = 0;
+    dir->parent = NULL;
+    dir->child = NULL;
+    dir->next = NULL;
+    dir->prev = NULL;
+
+    if (watch->fanotify)
+    {
+        struct file_handle* handle = haz_malloc(sizeof(struct file_handle) + MAX_HANDLE_SZ);
+        struct statfs info;
+        int mount_id;
+        handle->handle_bytes = MAX_HANDLE_SZ;
+        if (fanotify_mark(watch->fd, FAN_MARK_ADD | FAN_MARK_ONLYDIR | (root ? 0 : FAN_MARK_DONT_FOLLOW), WATCH_FANOTIFY_MASK, AT_FDCWD, path) != 0
+            || statfs(path, &info) != 0 || name_to_handle_at(AT_FDCWD, path, handle, &mount_id, root ? AT_SYMLINK_FOLLOW : 0) != 0)
+        {
+            if (root || (errno != ENOTDIR && errno != ENOENT)) // below a target it was removed or replaced, and its event is on its way
+            {
+                watch_warn(watch, "failed to watch", path);
+            }
+            free(handle);
+            return dir;
+        }
+        // the key is laid out like it comes in the event: fsid, handle_type and f_handle
+        dir->id_len = sizeof(fsid_t) + sizeof(int) + handle->handle_bytes;
+        dir->id = haz_malloc(dir->id_len);
+        memcpy(dir->id, &info.f_fsid, sizeof(fsid_t));
+        memcpy(dir->id + sizeof(fsid_t), &handle->handle_type, sizeof(int));
+        memcpy(dir->id + sizeof(fsid_t) + sizeof(int), handle->f_handle, handle->handle_bytes);
+        free(handle);
+        return dir;
+    }
+
+    if ((dir->wd = inotify_add_watch(watch->fd, path, WATCH_INOTIFY_MASK | (root ? 0 : IN_DONT_FOLLOW))) < 0)
+    {
+        if (root && errno != ENOSPC)
+        {
+            watch_warn(watch, "failed to watch", path);
+        }
+        else if (errno == ENOSPC)
+        {
+            pthread_mutex_lock(&watch->lock);
+            if (!watch->full)
+            {
+                fprintf(stderr, "out of inotify watches, raise fs.inotify.max_user_watches, changes below %s won't be seen\n", path);
+                watch->full = true;
+                *watch->exit_code = 1;
+            }
+            pthread_mutex_unlock(&watch->lock);
+        }
+        return dir;
+    }
+    dir->id_len = sizeof(int);
+    dir->id = haz_malloc(dir->id_len);
+    memcpy(dir->id, &dir->wd, sizeof(int));
+    return dir;
+}
+
+/**
+ * adds a scanned directory with its own size, parents are linked by watch_link once the scan is done
+ * a directory that is already known (seen twice while things are moving) is dropped
+ *
+ * @param watch     the watch
+ * @param dir     the directory from watch_begin
+ * @param own     metrics of the directory and the files in it
+ * @return      void
+ */
+void watch_record(struct watch* watch, struct watch_dir* dir, const struct metrics* own)
+{
+    dir->own = *own;
+    pthread_mutex_lock(&watch->lock);
+    if (watch_table_find(&watch->paths, dir->path, strlen(dir->path)) != NULL)
+    {
+        pthread_mutex_unlock(&watch->lock);
+        free(dir->path);
+        free(dir->id);
+        free(dir);
+        return;
+    }
+    watch_table_insert(&watch->paths, dir);
+    if (dir->id_len > 0 && watch_table_find(&watch->ids, dir->id, dir->id_len) == NULL)
+    {
+        watch_table_insert(&watch->ids, dir);
+    }
+    watch->unlinked = haz_append(watch->unlinked, &watch->num_unlinked, &watch->unlinked_size, sizeof(struct watch_dir*));
+    watch->unlinked[watch->num_unlinked - 1] = dir;
+    pthread_mutex_unlock(&watch->lock);
+}
+
+/**
+ * links the directories recorded during the last scan to their parents and adds their sizes to the totals
+ * the parent path is the path up to the last '/', since that's how target_appendstr built it
+ *
+ * @param watch     the watch
+ * @return      void
+ */
+void watch_link(struct watch* watch)
+{
+    for (size_t i = 0; i < watch->num_unlinked; i++)
+    {
+        struct watch_dir* dir = watch->unlinked[i];
+        char* slash = strrchr(dir->path, '/');
+        if (slash == NULL || slash == dir->path)
+        {
+            continue;
+        }
+        *slash = '\0';
+        struct watch_dir* parent = watch_table_find(&watch->paths, dir->path, strlen(dir->path));
+        *slash = '/';
+        if (parent != NULL && parent != dir)
+        {
+            dir->parent = parent;
+            dir->next = parent->child;
+            if (parent->child != NULL)
+            {
+                parent->child->prev = dir;
+            }
+            parent->child = dir;
+        }
+    }
+    for (size_t i = 0; i < watch->num_unlinked; i++) // all parents are set now
+    {
+        watch_propagate(watch->unlinked[i], &watch->unlinked[i]->own);
+    }
+    watch->num_unlinked = 0;
+}
+
+/**
+ * adds a change to a directory and all of its ancestors
+ *
+ * @param dir     the directory that changed, may be NULL
+ * @param delta     how much it changed
+ * @return      void
+ */
+void watch_propagate(struct watch_dir* dir, const struct metrics* delta)
+{
+    for (; dir != NULL; dir = dir->parent)
+    {
+        metrics_add(&dir->total, delta);
+    }
+}
+
+/**
+ * forgets a directory and everything under it, taking its size off its ancestors
+ *
+ * @param watch     the watch
+ * @param dir     the directory that is gone
+ * @return      void
+ */
+void watch_remove(struct watch* watch, struct watch_dir* dir)
+{
+    struct metrics delta;
+    metrics_zero(&delta);
+    metrics_sub(&delta, &dir->total);
+    watch_propagate(dir->parent, &delta);
+    if (dir->parent != NULL && dir->parent->child == dir)
+    {
+        dir->parent->child = dir->next;
+    }
+    if (dir->prev != NULL)
+    {
+        dir->prev->next = dir->next;
+    }
+    if (dir->next != NULL)
+    {
+        dir->next->prev = dir->prev;
+    }
+    watch_free_subtree(watch, dir);
+}
+
+/**
+ * frees a directory and everything under it, it has to be unlinked from its parent already
+ *
+ * @param watch     the watch
+ * @param dir     the directory to free
+ * @return      void
+ */
+void watch_free_subtree(struct watch* watch, struct watch_dir* dir)
+{
+    struct watch_dir* child = dir->child;
+    while (child != NULL)
+    {
+        struct watch_dir* next = child->next;
+        watch_free_subtree(watch, child);
+        child = next;
+    }
+    watch_free_dir(watch, dir);
+}
+
+/**
+ * removes a single directory from the tables and the kernel, and frees it
+ *
+ * @param watch     the watch
+ * @param dir     the directory to free
+ * @return      void
+ */
+void watch_free_dir(struct watch* watch, struct watch_dir* dir)
+{
+    watch_table_remove(&watch->paths, dir);
+    if (dir->id_len > 0 && watch_table_find(&watch->ids, dir->id, dir->id_len) == dir)
+    {
+        watch_table_remove(&watch->ids, dir);
+        if (!watch->fanotify) // fanotify marks go away with the inode, a moved directory just sends events nobody knows
+        {
+            inotify_rm_watch(watch->fd, dir->wd);
+        }
+    }
+    if (dir->dirty)
+    {
+        for (size_t i = 0; i < watch->num_dirty; i++)
+        {
+            if (watch->dirty[i] == dir)
+            {
+                watch->dirty[i] = NULL;
+            }
+        }
+    }
+    watch_entries_free(&dir->entries);
+    free(dir->pending);
+    free(dir->path);
+    free(dir->id);
+    free(dir);
+}
+
+/**
+ * sets up an empty file table
+ *
+ * @param entries     the table to set up
+ * @return      void
+ */
+void watch_entries_init(struct watch_entries* entries)
+{
+    entries->size = WATCH_ENTRIES;
+    entries->used = 0;
+    entries->live = 0;
+    if ((entries->slots = calloc(entries->size, sizeof(struct watch_entry))) == NULL)
+    {
+        fprintf(stderr, "failed to allocate space");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * frees a file table and the names in it, the table is left empty
+ *
+ * @param entries     the table to free
+ * @return      void
+ */
+void watch_entries_free(struct watch_entries* entries)
+{
+    for (size_t i = 0; i < entries->size; i++)
+    {
+        if (entries->slots[i].name != WATCH_ENTRY_TOMB)
+        {
+            free(entries->slots[i].name);
+        }
+    }
+    free(entries->slots);
+    entries->slots = NULL;
+    entries->size = 0;
+    entries->used = 0;
+    entries->live = 0;
+}
+
+/**
+ * finds the file with the given name
+ *
+ * @param entries     the table to look in
+ * @param name     name of the file
+ * @return      the file, or NULL if it isn't in the table
+ */
+struct watch_entry* watch_entry_find(struct watch_entries* entries, const char* name)
+{
+    uint64_t hash = target_hash(name, strlen(name));
+    for (size_t i = hash & (entries->size - 1); entries->slots[i].name != NULL; i = (i + 1) & (entries->size - 1))
+    {
+        struct watch_entry* entry = &entries->slots[i];
+        if (entry->name != WATCH_ENTRY_TOMB && entry->hash == hash && strcmp(entry->name, name) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * finds the file with the given name, or adds it with nothing counted yet
+ * the table is rebuilt when it's 3/4 full counting removed slots, and only doubled if half of it is in use
+ *
+ * @param entries     the table
+ * @param name     name of the file
+ * @return      the file, only valid until the next add
+ */
+struct watch_entry* watch_entry_add(struct watch_entries* entries, const char* name)
+{
+    struct watch_entry* entry = watch_entry_find(entries, name);
+    if (entry != NULL)
+    {
+        return entry;
+    }
+    if ((entries->used + 1) * 4 > entries->size * 3)
+    {
+        struct watch_entries old = *entries;
+        entries->size = old.live * 2 >= old.size ? old.size * 2 : old.size;
+        entries->used = old.live;
+        if ((entries->slots = calloc(entries->size, sizeof(struct watch_entry))) == NULL)
+        {
+            fprintf(stderr, "failed to allocate space");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < old.size; i++)
+        {
+            if (old.slots[i].name != NULL && old.slots[i].name != WATCH_ENTRY_TOMB)
+            {
+                size_t j = old.slots[i].hash & (entries->size - 1);
+                while (entries->slots[j].name != NULL)
+                {
+                    j = (j + 1) & (entries->size - 1);
+                }
+                entries->slots[j] = old.slots[i];
+            }
+        }
+        free(old.slots);
+    }
+    uint64_t hash = target_hash(name, strlen(name));
+    size_t i = hash & (entries->size - 1);
+    while (entries->slots[i].name != NULL)
+    {
+        i = (i + 1) & (entries->size - 1);
+    }
+    entry = &entries->slots[i];
+    entry->hash = hash;
+    entry->name = haz_strdup((char*)name);
+    entry->blocks = 0;
+    entry->bytes = 0;
+    entry->mode = 0;
+    entry->pending = false;
+    entries->used++;
+    entries->live++;
+    return entry;
+}
+
+/**
+ * removes a file, its slot is left as a tombstone until the table is rebuilt
+ *
+ * @param entries     the table
+ * @param entry     the file to remove
+ * @return      void
+ */
+void watch_entry_remove(struct watch_entries* entries, struct watch_entry* entry)
+{
+    free(entry->name);
+    entry->name = WATCH_ENTRY_TOMB;
+    entries->live--;
+}
+
+/**
+ * adds what a file was last counted as
+ *
+ * @param entry     the file
+ * @param metrics     where to add it
+ * @return      void
+ */
+void watch_entry_metrics(const struct watch_entry* entry, struct metrics* metrics)
+{
+    if (entry->mode == 0)
+    {
+        return;
+    }
+    struct stat file;
+    memset(&file, 0, sizeof(file));
+    file.st_blocks = entry->blocks;
+    file.st_size = entry->bytes;
+    file.st_mode = entry->mode;
+    metrics_stat(metrics, &file);
+}
+
+/**
+ * remembers what a file counts as now
+ *
+ * @param entry     the file
+ * @param file     its stat
+ * @return      void
+ */
+void watch_entry_set(struct watch_entry* entry, const struct stat* file)
+{
+    entry->blocks = file->st_blocks;
+    entry->bytes = file->st_size;
+    entry->mode = file->st_mode;
+}
+
+/**
+ * marks a directory to be looked at again at the next tick
+ * only the named entry is stated then, unless there's no name, the files of the directory aren't known yet
+ * or so many of them changed that the directory is read in full instead
+ *
+ * @param watch     the watch
+ * @param dir     the directory that changed
+ * @param name     the entry that changed, NULL if it's not known
+ * @return      void
+ */
+void watch_mark_dirty(struct watch* watch, struct watch_dir* dir, const char* name)
+{
+    if (!dir->dirty)
+    {
+        dir->dirty = true;
+        watch->dirty = haz_append(watch->dirty, &watch->num_dirty, &watch->dirty_size, sizeof(struct watch_dir*));
+        watch->dirty[watch->num_dirty - 1] = dir;
+    }
+    if (dir->reread)
+    {
+        return;
+    }
+    if (name == NULL || dir->entries.slots == NULL)
+    {
+        dir->reread = true;
+        return;
+    }
+    struct watch_entry* entry = watch_entry_find(&dir->entries, name);
+    if (entry != NULL && entry->pending)
+    {
+        return;
+    }
+    if (dir->num_pending >= WATCH_PENDING && dir->num_pending * 2 >= dir->entries.live) // reading it is cheaper, and only this directory is read
+    {
+        dir->reread = true;
+        return;
+    }
+    entry = watch_entry_add(&dir->entries, name);
+    entry->pending = true;
+    dir->pending = haz_append(dir->pending, &dir->num_pending, &dir->pending_size, sizeof(char*));
+    dir->pending[dir->num_pending - 1] = entry->name;
+}
+
+/**
+ * builds the path of an entry in a directory
+ *
+ * @param dir     the directory
+ * @param name     name of the entry
+ * @return      the allocated path
+ */
+char* watch_childpath(struct watch_dir* dir, const char* name)
+{
+    return target_appendstr(haz_strdup(dir->path), name);
+}
+
+/**
+ * queues a new directory to be scanned at the next tick
+ *
+ * @param watch     the watch
+ * @param dir     the directory it was made in
+ * @param name     name of the new directory
+ * @return      void
+ */
+void watch_created(struct watch* watch, struct watch_dir* dir, const char* name)
+{
+    watch->created = haz_append(watch->created, &watch->num_created, &watch->created_size, sizeof(char*));
+    watch->created[watch->num_created - 1] = watch_childpath(dir, name);
+}
+
+/**
+ * forgets a directory that was removed or moved away
+ *
+ * @param watch     the watch
+ * @param dir     the directory it was in
+ * @param name     name of the directory that is gone
+ * @return      void
+ */
+void watch_deleted(struct watch* watch, struct watch_dir* dir, const char* name)
+{
+    char* path = watch_childpath(dir, name);
+    struct watch_dir* child = watch_table_find(&watch->paths, path, strlen(path));
+    if (child != NULL && child->parent == dir)
+    {
+        watch_remove(watch, child);
+    }
+    free(path);
+}
+
+/**
+ * handles one event, whichever backend it came from
+ *
+ * @param watch     the watch
+ * @param dir     the watched directory the event is about
+ * @param name     the entry in the directory, or NULL
+ * @param is_dir     true if the entry is a directory
+ * @param created     true if the entry was created or moved in
+ * @param deleted     true if the entry was deleted or moved out
+ * @param self     true if the watched directory itself went away
+ * @return      void
+ */
+void watch_event(struct watch* watch, struct watch_dir* dir, const char* name, bool is_dir, bool created, bool deleted, bool self)
+{
+    if (self)
+    {
+        if (dir->parent == NULL) // a root, nobody else is going to tell us
+        {
+            watch_remove(watch, dir);
+        }
+        return;
+    }
+    if (is_dir && name != NULL && created)
+    {
+        watch_created(watch, dir, name);
+    }
+    else if (is_dir && name != NULL && deleted)
+    {
+        watch_deleted(watch, dir, name);
+    }
+    watch_mark_dirty(watch, dir, name);
+}
+
+/**
+ * goes through a buffer of inotify events
+ *
+ * @param watch     the watch
+ * @param buffer     the events
+ * @param length     number of bytes read
+ * @return      void
+ */
+void watch_read_inotify(struct watch* watch, char* buffer, ssize_t length)
+{
+    for (char* c = buffer; c < buffer + length;)
+    {
+        struct inotify_event* event = (struct inotify_event*)c;
+        c += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW)
+        {
+            watch->overflow = true;
+            continue;
+        }
+        struct watch_dir* dir = watch_table_find(&watch->ids, &event->wd, sizeof(int));
+        if (dir == NULL)
+        {
+            continue;
+        }
+        watch_event(watch, dir, event->len > 0 ? event->name : NULL, event->mask & IN_ISDIR,
+                    event->mask & (IN_CREATE | IN_MOVED_TO), event->mask & (IN_DELETE | IN_MOVED_FROM),
+                    event->mask & (IN_DELETE_SELF | IN_MOVE_SELF));
+    }
+}
+
+/**
+ * goes through a buffer of fanotify events, the directory is found from the fsid and file handle in the event
+ *
+ * @param watch     the watch
+ * @param buffer     the events
+ * @param length     number of bytes read
+ * @return      void
+ */
+void watch_read_fanotify(struct watch* watch, char* buffer, ssize_t length)
+{
+    for (struct fanotify_event_metadata* event = (struct fanotify_event_metadata*)buffer; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length))
+    {
+        if (event->fd >= 0)
+        {
+            close(event->fd);
+        }
+        if (event->mask & FAN_Q_OVERFLOW)
+        {
+            watch->overflow = true;
+            continue;
+        }
+        struct fanotify_event_info_fid* info = (struct fanotify_event_info_fid*)(event + 1);
+        if ((char*)info + sizeof(*info) > (char*)event + event->event_len
+            || (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME && info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID))
+        {
+            continue;
+        }
+        struct file_handle* handle = (struct file_handle*)info->handle;
+        unsigned char id[WATCH_IDSIZE];
+        size_t id_len = sizeof(fsid_t) + sizeof(int) + handle->handle_bytes;
+        if (handle->handle_bytes > MAX_HANDLE_SZ)
+        {
+            continue;
+        }
+        memcpy(id, &info->fsid, sizeof(fsid_t));
+        memcpy(id + sizeof(fsid_t), &handle->handle_type, sizeof(int));
+        memcpy(id + sizeof(fsid_t) + sizeof(int), handle->f_handle, handle->handle_bytes);
+        struct watch_dir* dir = watch_table_find(&watch->ids, id, id_len);
+        if (dir == NULL)
+        {
+            continue;
+        }
+
+        const char* name = NULL;
+        if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME)
+        {
+            name = (const char*)handle->f_handle + handle->handle_bytes;
+            if (strcmp(name, ".") == 0)
+            {
+                name = NULL;
+            }
+        }
+        watch_event(watch, dir, name, event->mask & FAN_ONDIR, event->mask & (FAN_CREATE | FAN_MOVED_TO),
+                    event->mask & (FAN_DELETE | FAN_MOVED_FROM), (event->mask & (FAN_DELETE_SELF | FAN_MOVE_SELF)) && name == NULL);
+    }
+}
+
+/**
+ * reads the whole directory again, remembers every file in it and moves the difference up to its ancestors
+ *
+ * @param dir     the directory to read
+ * @return      void
+ */
+void watch_reread(struct watch_dir* dir)
+{
+    struct stat file;
+    DIR* d;
+    dir->num_pending = 0; // the names belong to the entries that are replaced
+    if ((d = opendir(dir->path)) == NULL) // gone, its parent gets the event for it
+    {
+        dir->reread = true;
+        return;
+    }
+    if (fstat(dirfd(d), &file) != 0)
+    {
+        perror("fstat failed");
+        exit(EXIT_FAILURE);
+    }
+    struct metrics self;
+    metrics_zero(&self);
+    metrics_stat(&self, &file);
+    struct metrics own = self;
+    struct watch_entries entries;
+    watch_entries_init(&entries);
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (entry->d_type == DT_DIR || fstatat(dirfd(d), entry->d_name, &file, AT_SYMLINK_NOFOLLOW) != 0 || S_ISDIR(file.st_mode))
+        {
+            continue;
+        }
+        watch_entry_set(watch_entry_add(&entries, entry->d_name), &file);
+        metrics_stat(&own, &file);
+    }
+    if (closedir(d) != 0)
+    {
+        perror("closedir failed");
+        exit(EXIT_FAILURE);
+    }
+    watch_entries_free(&dir->entries);
+    dir->entries = entries;
+    dir->self = self;
+    dir->reread = false;
+    struct metrics delta = own;
+    metrics_sub(&delta, &dir->own);
+    watch_propagate(dir, &delta);
+    dir->own = own;
+}
+
+/**
+ * stats the directory and the entries that had events, and moves the difference up to its ancestors
+ * an entry that is gone, or is a directory now (those are watched on their own), takes off what it counted before
+ *
+ * @param dir     the directory that changed
+ * @return      void
+ */
+void watch_restat(struct watch_dir* dir)
+{
+    if (dir->reread || dir->entries.slots == NULL)
+    {
+        watch_reread(dir);
+        return;
+    }
+    struct stat file;
+    int fd;
+    if ((fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 || fstat(fd, &file) != 0) // gone, its parent gets the event for it
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        dir->reread = true;
+        dir->num_pending = 0;
+        return;
+    }
+    struct metrics delta;
+    metrics_zero(&delta);
+    metrics_stat(&delta, &file);
+    metrics_sub(&delta, &dir->self);
+    metrics_add(&dir->self, &delta);
+    for (size_t i = 0; i < dir->num_pending; i++)
+    {
+        struct watch_entry* entry = watch_entry_find(&dir->entries, dir->pending[i]);
+        struct metrics old;
+        metrics_zero(&old);
+        watch_entry_metrics(entry, &old);
+        metrics_sub(&delta, &old);
+        if (fstatat(fd, entry->name, &file, AT_SYMLINK_NOFOLLOW) == 0 && !S_ISDIR(file.st_mode))
+        {
+            watch_entry_set(entry, &file);
+            metrics_stat(&delta, &file);
+            entry->pending = false;
+        }
+        else
+        {
+            watch_entry_remove(&dir->entries, entry);
+        }
+    }
+    dir->num_pending = 0;
+    close(fd);
+    metrics_add(&dir->own, &delta);
+    watch_propagate(dir, &delta);
+}
+
+/**
+ * compares two paths for qsort
+ *
+ * @param a     pointer to the first char*
+ * @param b     pointer to the second char*
+ * @return      <0, 0 or >0 like strcmp
+ */
+int watch_compare(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * signal handler that makes the watch loop stop
+ *
+ * @param signal     the signal
+ * @return      void
+ */
+void watch_stop(int signal)
+{
+    (void)signal;
+    watch_stopped = 1;
+}
\ No newline at end of file
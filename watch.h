@@ -0,0 +1,140 @@
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include "target.h"
+
+#define WATCH_INTERVAL 5 // seconds between printing the totals
+#define WATCH_TABLESIZE 1024
+#define WATCH_EVENTS 65536 // size of the buffer events are read into
+#define WATCH_ENTRIES 16 // starting slots of the file table of a directory, has to be a power of two
+#define WATCH_PENDING 4096 // changed names a directory queues before it's read in full, if that's at least half of its files
+#define WATCH_INOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) // IN_DONT_FOLLOW is added below the targets
+#define WATCH_FANOTIFY_MASK (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_DELETE_SELF | FAN_MOVE_SELF | FAN_ONDIR | FAN_EVENT_ON_CHILD)
+
+// a file in a watched directory, what it last counted so that a change only has to stat it
+struct watch_entry{
+    uint64_t hash;
+    char* name; // NULL for an empty slot
+    int64_t blocks;
+    int64_t bytes;
+    mode_t mode; // 0 if it isn't counted yet
+    bool pending; // had an event since the last tick
+};
+
+// open addressing hash table of the files of a directory, keyed on the name
+struct watch_entries{
+    struct watch_entry* slots;
+    size_t size;
+    size_t used; // including removed slots
+    size_t live;
+};
+
+// a directory that is being watched, own is the size of the directory and its files, total includes the subdirectories
+// the files are only kept once something in the directory changed, the first change reads it all
+struct watch_dir{
+    char* path;
+    unsigned char* id; // inotify watch descriptor or fanotify fsid and file handle, events are looked up by this
+    size_t id_len;
+    int wd;
+    struct metrics own;
+    struct metrics total;
+    struct metrics self; // the directory itself, part of own
+    bool dirty;
+    bool reread; // has to be read in full at the next tick
+    struct watch_entries entries;
+    char** pending; // names of the entries that had an event, they belong to the entries
+    size_t num_pending;
+    size_t pending_size;
+
+    struct watch_dir* parent;
+    struct watch_dir* child;
+    struct watch_dir* next;
+    struct watch_dir* prev;
+};
+
+// open addressing hash table of directories, keyed on either the path or the id
+struct watch_slot{
+    uint64_t hash;
+    struct watch_dir* dir;
+};
+struct watch_table{
+    struct watch_slot* slots;
+    size_t size;
+    size_t used;
+    bool by_id;
+};
+
+// structure that holds everything the watch needs, records are added by the threads during scans
+struct watch{
+    int fd;
+    bool fanotify;
+    bool full; // ran out of watches
+    bool overflow;
+    int interval;
+    pthread_mutex_t lock;
+
+    struct watch_table paths;
+    struct watch_table ids;
+    struct watch_dir** unlinked; // recorded during the last scan, parents are set after it
+    size_t num_unlinked;
+    size_t unlinked_size;
+    struct watch_dir** dirty;
+    size_t num_dirty;
+    size_t dirty_size;
+    char** created; // new directories to scan at the next tick
+    size_t num_created;
+    size_t created_size;
+
+    int* exit_code;
+};
+
+extern volatile sig_atomic_t watch_stopped;
+
+void watch_table_init(struct watch_table* table, bool by_id);
+struct watch_dir* watch_table_find(struct watch_table* table, const void* key, size_t len);
+void watch_table_insert(struct watch_table* table, struct watch_dir* dir);
+void watch_table_remove(struct watch_table* table, struct watch_dir* dir);
+void watch_init(struct watch* watch, int interval, int* exit_code);
+void watch_destroy(struct watch* watch);
+void watch_warn(struct watch* watch, const char* message, const char* path);
+struct watch_dir* watch_begin(struct watch* watch, char* path, bool root);
+void watch_record(struct watch* watch, struct watch_dir* dir, const struct metrics* own);
+void watch_free_dir(struct watch* watch, struct watch_dir* dir);
+void watch_link(struct watch* watch);
+void watch_propagate(struct watch_dir* dir, const struct metrics* delta);
+void watch_remove(struct watch* watch, struct watch_dir* dir);
+void watch_free_subtree(struct watch* watch, struct watch_dir* dir);
+void watch_entries_init(struct watch_entries* entries);
+void watch_entries_free(struct watch_entries* entries);
+struct watch_entry* watch_entry_find(struct watch_entries* entries, const char* name);
+struct watch_entry* watch_entry_add(struct watch_entries* entries, const char* name);
+void watch_entry_remove(struct watch_entries* entries, struct watch_entry* entry);
+void watch_entry_metrics(const struct watch_entry* entry, struct metrics* metrics);
+void watch_entry_set(struct watch_entry* entry, const struct stat* file);
+void watch_mark_dirty(struct watch* watch, struct watch_dir* dir, const char* name);
+void watch_created(struct watch* watch, struct watch_dir* dir, const char* name);
+char* watch_childpath(struct watch_dir* dir, const char* name);
+void watch_deleted(struct watch* watch, struct watch_dir* dir, const char* name);
+void watch_event(struct watch* watch, struct watch_dir* dir, const char* name, bool is_dir, bool created, bool deleted, bool self);
+void watch_read_inotify(struct watch* watch, char* buffer, ssize_t length);
+void watch_read_fanotify(struct watch* watch, char* buffer, ssize_t length);
+void watch_reread(struct watch_dir* dir);
+void watch_restat(struct watch_dir* dir);
+int watch_compare(const void* a, const void* b);
+void watch_stop(int signal);
\ No newline at end of file